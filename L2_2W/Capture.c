@@ -0,0 +1,208 @@
+#include "Capture.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WRITER_NAP_NS 100000 // how long the writer sleeps when every ring is empty
+
+_Atomic uint32_t captureActive;
+_Thread_local uint32_t captureSession;
+_Thread_local CaptureRing *captureRing;
+
+/*
+Rings are handed out by bumping threads, so joining needs no lock; a
+slot stays NULL until its ring is ready (or for good, if it couldn't
+be allocated). Everything below rings is only touched by the writer
+thread, and by stopCapture once the writer is gone.
+*/
+typedef struct Capture {
+  char *path;
+  _Atomic uint32_t threads; // slots handed out, may go past MAX_CAPTURE_THREADS
+  _Atomic uint32_t stopping;
+  _Atomic(CaptureRing *) rings[MAX_CAPTURE_THREADS];
+  FILE *files[MAX_CAPTURE_THREADS];
+  uint64_t written[MAX_CAPTURE_THREADS];
+  int error; // errno of the first failure, 0 if none
+  pthread_t writer;
+} Capture;
+
+static Capture capture;
+static uint32_t lastSession;
+
+CaptureRing *joinCapture(uint32_t session) {
+
+  uint32_t slot = atomic_fetch_add(&capture.threads, 1);
+  CaptureRing *ring = NULL;
+
+  if (slot < MAX_CAPTURE_THREADS && (ring = aligned_alloc(64, sizeof(CaptureRing))) != NULL) {
+    memset(ring, 0, sizeof(*ring));
+    ring->limit = CAPTURE_RING_RECORDS;
+    atomic_store_explicit(&capture.rings[slot], ring, memory_order_release);
+  }
+
+  captureSession = session;
+  captureRing = ring;
+  return ring;
+}
+
+/* Opens the trace of a ring, leaving room for the header. */
+static FILE *openTrace(uint32_t slot) {
+
+  char name[4096];
+  TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, 0};
+  FILE *file;
+
+  snprintf(name, sizeof(name), "%s.%u", capture.path, slot);
+  if ((file = fopen(name, "wb")) == NULL)
+    return NULL;
+  if (fwrite(&header, sizeof(header), 1, file) != 1) {
+    fclose(file);
+    return NULL;
+  }
+  return file;
+}
+
+/*
+Writes out everything in a ring. Once a trace can't be written we keep
+emptying its ring, so that its thread doesn't start dropping accesses.
+Returns how many records there were.
+*/
+static uint64_t drainRing(uint32_t slot) {
+
+  CaptureRing *ring = atomic_load_explicit(&capture.rings[slot], memory_order_acquire);
+  uint64_t head, tail, count;
+
+  if (ring == NULL)
+    return 0;
+
+  tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+  head = atomic_load_explicit(&ring->head, memory_order_acquire);
+  count = head - tail;
+  if (count == 0)
+    return 0;
+
+  if (capture.files[slot] == NULL && capture.error == 0 &&
+      (capture.files[slot] = openTrace(slot)) == NULL)
+    capture.error = errno;
+
+  while (tail != head) {
+    uint64_t start = tail & (CAPTURE_RING_RECORDS - 1);
+    uint64_t n = head - tail < CAPTURE_RING_RECORDS - start ? head - tail
+                                                            : CAPTURE_RING_RECORDS - start;
+
+    if (capture.files[slot] != NULL && capture.error == 0 &&
+        fwrite(&ring->records[start], sizeof(TraceRecord), n, capture.files[slot]) != n)
+      capture.error = errno;
+    tail += n;
+  }
+
+  atomic_store_explicit(&ring->tail, tail, memory_order_release);
+  capture.written[slot] += count;
+  return count;
+}
+
+/*
+The writer goes round the rings until stopCapture asks it to finish.
+By then no thread is appending any more, so one last round after
+seeing the request empties every ring for good.
+*/
+static void *writerMain(void *arg) {
+
+  struct timespec nap = {0, WRITER_NAP_NS};
+
+  (void)arg;
+  for (;;) {
+    uint32_t stopping = atomic_load(&capture.stopping);
+    uint32_t slots = atomic_load(&capture.threads);
+    uint64_t moved = 0;
+
+    for (uint32_t s = 0; s < slots && s < MAX_CAPTURE_THREADS; s++)
+      moved += drainRing(s);
+    if (stopping)
+      return NULL;
+    if (moved == 0)
+      nanosleep(&nap, NULL);
+  }
+}
+
+int startCapture(const char *path) {
+
+  if (atomic_load(&captureActive) != 0) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  capture.path = strdup(path);
+  if (capture.path == NULL)
+    exit(-1);
+  atomic_store(&capture.threads, 0);
+  atomic_store(&capture.stopping, 0);
+  for (uint32_t s = 0; s < MAX_CAPTURE_THREADS; s++) {
+    atomic_store(&capture.rings[s], NULL);
+    capture.files[s] = NULL;
+    capture.written[s] = 0;
+  }
+  capture.error = 0;
+
+  if ((errno = pthread_create(&capture.writer, NULL, writerMain, NULL)) != 0) {
+    free(capture.path);
+    return -1;
+  }
+
+  atomic_store(&captureActive, ++lastSession);
+  return 0;
+}
+
+int stopCapture(CaptureStats *stats) {
+
+  uint32_t slots;
+
+  if (atomic_load(&captureActive) == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  atomic_store(&captureActive, 0);
+  atomic_store(&capture.stopping, 1);
+  pthread_join(capture.writer, NULL);
+
+  memset(stats, 0, sizeof(*stats));
+  slots = atomic_load(&capture.threads);
+  stats->Untraced = slots > MAX_CAPTURE_THREADS ? slots - MAX_CAPTURE_THREADS : 0;
+
+  // Now that the counts are known, fill in the headers
+  for (uint32_t s = 0; s < slots && s < MAX_CAPTURE_THREADS; s++) {
+    CaptureRing *ring = atomic_load(&capture.rings[s]);
+    FILE *file = capture.files[s];
+    TraceHeader header = {TRACE_MAGIC, TRACE_VERSION, capture.written[s]};
+
+    if (ring == NULL) {
+      stats->Untraced++;
+      continue;
+    }
+    stats->Dropped += ring->dropped;
+    free(ring);
+
+    if (file == NULL)
+      continue;
+    if (capture.error == 0 &&
+        (fseek(file, 0, SEEK_SET) < 0 || fwrite(&header, sizeof(header), 1, file) != 1))
+      capture.error = errno;
+    if (fclose(file) != 0 && capture.error == 0)
+      capture.error = errno;
+    stats->Threads++;
+    stats->Records += capture.written[s];
+  }
+
+  free(capture.path);
+  capture.path = NULL;
+  if (capture.error != 0) {
+    errno = capture.error;
+    return -1;
+  }
+  return 0;
+}
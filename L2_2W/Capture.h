@@ -0,0 +1,104 @@
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include "Cache.h"
+#include "Trace.h"
+
+/*
+Trace capture for instrumented programs. While a capture is running,
+every read() and write() (and every access of the batch interfaces)
+made by any thread is appended to that thread's ring buffer, and a
+background writer thread drains the rings into binary traces (see
+Trace.h), one per thread: path.0, path.1... in the order the threads
+first made an access. Each file can be replayed on a core of its own
+by TraceReplay.
+
+A ring has a single producer (its thread) and a single consumer (the
+writer), so appending is a couple of loads and stores with no locks and
+no system calls. If the writer falls so far behind that a ring fills
+up, the access is dropped and counted rather than making the program
+wait. Threads beyond MAX_CAPTURE_THREADS are not captured at all.
+*/
+
+#define CAPTURE_RING_RECORDS 262144 // per thread (4 MiB), a power of two
+#define MAX_CAPTURE_THREADS 64
+
+/*
+The two indices are on host cache lines of their own, so the producer
+and the consumer don't steal the line from each other on every access.
+limit is the producer's copy of tail + CAPTURE_RING_RECORDS, refreshed
+only when head reaches it.
+*/
+typedef struct CaptureRing {
+  _Atomic uint64_t head __attribute__((aligned(64))); // next record to fill
+  uint64_t limit;
+  uint64_t dropped;
+  _Atomic uint64_t tail __attribute__((aligned(64))); // next record to write out
+  TraceRecord records[CAPTURE_RING_RECORDS];
+} CaptureRing;
+
+typedef struct CaptureStats {
+  uint32_t Threads;  // traces written
+  uint32_t Untraced; // threads that got no ring
+  uint64_t Records;  // written to the traces
+  uint64_t Dropped;  // lost to full rings
+} CaptureStats;
+
+/*
+Starts capturing into path.N. Returns 0, or -1 (with errno set) if a
+capture is already running or the writer thread can't be started.
+*/
+int startCapture(const char *);
+
+/*
+Stops capturing, writes out whatever is left in the rings and closes
+the traces. No thread may still be inside read() or write() when this
+is called, as their rings are freed. Returns 0, or -1 (with errno set)
+if there was no capture or a trace couldn't be written.
+*/
+int stopCapture(CaptureStats *);
+
+/*
+Number of the capture running (they are numbered from 1), or 0. Each
+thread keeps the number of the capture its ring belongs to.
+*/
+extern _Atomic uint32_t captureActive;
+extern _Thread_local uint32_t captureSession;
+extern _Thread_local CaptureRing *captureRing;
+
+/*
+Gives the calling thread a ring in the given capture, or NULL if it
+can't have one (it then stays without one until the next capture).
+*/
+CaptureRing *joinCapture(uint32_t);
+
+static inline void captureAccess(uint32_t session, uint64_t address, uint32_t mode) {
+
+  CaptureRing *ring = captureRing;
+  uint64_t head;
+  TraceRecord *record;
+
+  if (captureSession != session)
+    ring = joinCapture(session);
+  if (ring == NULL)
+    return;
+
+  head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+  if (head == ring->limit) {
+    ring->limit = atomic_load_explicit(&ring->tail, memory_order_acquire) + CAPTURE_RING_RECORDS;
+    if (head == ring->limit) {
+      ring->dropped++;
+      return;
+    }
+  }
+
+  record = &ring->records[head & (CAPTURE_RING_RECORDS - 1)];
+  record->Address = address;
+  record->Mode = (uint8_t)mode;
+  record->Width = WORD_SIZE;
+  atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+}
+
+#endif
@@ -0,0 +1,312 @@
+#include "Checkpoint.h"
+#include "TagMatch.h"
+
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+/*
+<unistd.h> would clash with our read() and write() (see Trace.c), so
+files are opened through stdio and mapped through fileno().
+*/
+
+#define LAYOUT ((uint64_t)sizeof(Simulator) << 32 | (uint64_t)sizeof(Cache) << 16 | \
+                (uint64_t)sizeof(WriteBufferEntry))
+
+/*
+Where a checkpoint is being written to or read from. The same walk over
+the simulator does both, so the arrays are always in the same order.
+*/
+typedef struct Stream {
+  FILE *file;          // when saving
+  const uint8_t *base; // when loading, the mapped file
+  uint64_t offset;
+  uint64_t length;     // of the file, when loading
+  uint32_t data;       // the data arrays are included
+  int error;           // errno of the first failure, 0 if none
+} Stream;
+
+static uint64_t alignUp(uint64_t x) {
+  return (x + CHECKPOINT_ALIGN - 1) & ~(uint64_t)(CHECKPOINT_ALIGN - 1);
+}
+
+/*
+Saving, writes bytes of array to the next aligned offset and returns
+array. Loading, returns a copy of the array at that offset instead,
+allocated like the simulator's own arrays, or NULL once something has
+failed.
+*/
+static void *transfer(Stream *s, void *array, uint64_t bytes) {
+
+  static const uint8_t padding[CHECKPOINT_ALIGN] = {0};
+  uint64_t start = alignUp(s->offset);
+  void *copy;
+
+  if (s->error != 0)
+    return s->file != NULL ? array : NULL;
+
+  if (s->file != NULL) {
+    if (fwrite(padding, 1, start - s->offset, s->file) != start - s->offset ||
+        fwrite(array, 1, bytes, s->file) != bytes)
+      s->error = errno;
+    s->offset = start + bytes;
+    return array;
+  }
+
+  if (start > s->length || bytes > s->length - start) {
+    s->error = EINVAL;
+    return NULL;
+  }
+  copy = aligned_alloc(CHECKPOINT_ALIGN, alignUp(bytes ? bytes : 1));
+  if (copy == NULL)
+    exit(-1);
+  memcpy(copy, s->base + start, bytes);
+  s->offset = start + bytes;
+  return copy;
+}
+
+/* Clears every pointer of a level, once it belongs to another simulator. */
+static void clearCache(Cache *cache) {
+
+  Prefetcher *p = &cache->prefetcher;
+
+  cache->tags = NULL;
+  cache->replacement.state = NULL;
+  cache->validBits = cache->dirtyBits = cache->sharedBits = NULL;
+  cache->data = NULL;
+  p->strides = NULL;
+  p->streams = NULL;
+  p->blocks = p->ready = NULL;
+  p->data = NULL;
+  cache->prefetchedBits = cache->ready = NULL;
+  cache->victim.data = NULL;
+}
+
+static void clearPointers(Simulator *sim) {
+  for (uint32_t c = 0; c < MAX_CORES; c++) {
+    clearCache(&sim->cores[c].l1_cache);
+    sim->cores[c].write_buffer.entries = NULL;
+  }
+  clearCache(&sim->l2_cache);
+  memset(&sim->DRAM, 0, sizeof(sim->DRAM));
+  sim->core = NULL;
+}
+
+/*
+A level that was never set up has nothing to save: it will be set up
+on its next access, after loading too.
+*/
+static void transferCache(Stream *s, Cache *cache) {
+
+  CacheGeometry *g = &cache->geometry;
+  Prefetcher *p = &cache->prefetcher;
+  uint64_t bitmap = (g->Lines + 63) / 64 * sizeof(uint64_t);
+  uint64_t slots = (uint64_t)p->config.Entries * p->config.Degree;
+
+  if (!cache->init)
+    return;
+
+  cache->tags = transfer(s, cache->tags, (g->Lines + TAG_PADDING) * sizeof(uint64_t));
+  cache->replacement.state = transfer(s, cache->replacement.state,
+                                      (uint64_t)g->Sets * cache->replacement.Words *
+                                          sizeof(uint64_t));
+  cache->validBits = transfer(s, cache->validBits, bitmap);
+  cache->dirtyBits = transfer(s, cache->dirtyBits, bitmap);
+  cache->sharedBits = transfer(s, cache->sharedBits, bitmap);
+  if (s->data) {
+    cache->data = transfer(s, cache->data, g->Size);
+    if (cache->victim.Entries > 0)
+      cache->victim.data = transfer(s, cache->victim.data,
+                                    (uint64_t)cache->victim.Entries * g->BlockSize);
+  }
+
+  switch (p->config.Type) {
+  case PREFETCH_NEXT_LINE:
+  case PREFETCH_STRIDE:
+    cache->prefetchedBits = transfer(s, cache->prefetchedBits, bitmap);
+    cache->ready = transfer(s, cache->ready, g->Lines * sizeof(uint64_t));
+    if (p->config.Type == PREFETCH_STRIDE)
+      p->strides = transfer(s, p->strides, p->config.Entries * sizeof(StrideEntry));
+    break;
+  case PREFETCH_STREAM:
+    p->streams = transfer(s, p->streams, p->config.Entries * sizeof(StreamBuffer));
+    p->blocks = transfer(s, p->blocks, slots * sizeof(uint64_t));
+    p->ready = transfer(s, p->ready, slots * sizeof(uint64_t));
+    if (s->data)
+      p->data = transfer(s, p->data, slots * g->BlockSize);
+    break;
+  }
+}
+
+/* Every array of the simulator but the DRAM pages, in checkpoint order. */
+static void transferArrays(Stream *s, Simulator *sim) {
+
+  uint32_t entries = sim->write_policy.BufferEntries;
+
+  for (uint32_t c = 0; c < MAX_CORES; c++) {
+    transferCache(s, &sim->cores[c].l1_cache);
+    if (entries > 0)
+      sim->cores[c].write_buffer.entries = transfer(s, sim->cores[c].write_buffer.entries,
+                                                    entries * sizeof(WriteBufferEntry));
+  }
+  transferCache(s, &sim->l2_cache);
+}
+
+/*********************** Saving *************************/
+
+int saveCheckpoint(Simulator *sim, const char *path, uint32_t withData) {
+
+  CheckpointHeader header = {CHECKPOINT_MAGIC, CHECKPOINT_VERSION, LAYOUT, 0,
+                             (uint32_t)(sim->core - sim->cores), 0, 0};
+  Stream s = {.data = withData && !sim->timing_only};
+  Simulator *copy;
+  Memory *dram = &sim->DRAM;
+
+  if ((s.file = fopen(path, "wb")) == NULL)
+    return -1;
+
+  // The structure goes in without the pointers, which mean nothing in another process
+  copy = malloc(sizeof(Simulator));
+  if (copy == NULL)
+    exit(-1);
+  memcpy(copy, sim, sizeof(Simulator));
+  clearPointers(copy);
+
+  if (s.data) {
+    header.Flags |= CHECKPOINT_DATA;
+    header.Pages = dram->used;
+  }
+
+  transfer(&s, &header, sizeof(header));
+  transfer(&s, copy, sizeof(Simulator));
+  free(copy);
+  transferArrays(&s, sim);
+
+  // The page numbers, then the pages in the same order
+  if (s.data) {
+    uint64_t *numbers = malloc(dram->used * sizeof(uint64_t) + 1);
+    uint64_t n = 0;
+
+    if (numbers == NULL)
+      exit(-1);
+    for (uint64_t i = nextPage(dram, 0); i < dram->tableSize; i = nextPage(dram, i + 1))
+      numbers[n++] = dram->pageNumbers[i];
+    transfer(&s, numbers, n * sizeof(uint64_t));
+    free(numbers);
+    for (uint64_t i = nextPage(dram, 0); i < dram->tableSize; i = nextPage(dram, i + 1))
+      transfer(&s, dram->pages[i], DRAM_PAGE_SIZE);
+  }
+
+  // Now that the length is known, fill in the header
+  header.Length = s.offset;
+  if (s.error == 0 &&
+      (fseek(s.file, 0, SEEK_SET) < 0 || fwrite(&header, sizeof(header), 1, s.file) != 1))
+    s.error = errno;
+  if (fclose(s.file) != 0 && s.error == 0)
+    s.error = errno;
+
+  if (s.error != 0) {
+    errno = s.error;
+    return -1;
+  }
+  return 0;
+}
+
+/*********************** Loading *************************/
+
+int loadCheckpoint(Simulator *sim, const char *path) {
+
+  struct stat st;
+  const CheckpointHeader *header;
+  Simulator *loaded;
+  Stream s = {0};
+  FILE *file;
+  void *base;
+  uint32_t core;
+
+  if ((file = fopen(path, "rb")) == NULL)
+    return -1;
+  if (fstat(fileno(file), &st) < 0) {
+    fclose(file);
+    return -1;
+  }
+  if ((size_t)st.st_size < sizeof(CheckpointHeader)) {
+    fclose(file);
+    errno = EINVAL;
+    return -1;
+  }
+
+  s.length = (uint64_t)st.st_size;
+  base = mmap(NULL, s.length, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+  fclose(file); // the mapping keeps its own reference to the file
+  if (base == MAP_FAILED)
+    return -1;
+  madvise(base, s.length, MADV_SEQUENTIAL);
+
+  s.base = base;
+  header = (const CheckpointHeader *)base;
+  if (header->Magic != CHECKPOINT_MAGIC || header->Version != CHECKPOINT_VERSION ||
+      header->Layout != LAYOUT || header->Length != s.length || header->Core >= MAX_CORES ||
+      header->Pages > s.length / DRAM_PAGE_SIZE) {
+    munmap(base, s.length);
+    errno = EINVAL;
+    return -1;
+  }
+  s.data = (header->Flags & CHECKPOINT_DATA) != 0;
+  core = header->Core;
+  s.offset = sizeof(CheckpointHeader);
+
+  /*
+  Everything is loaded into a simulator of its own first, so that a
+  damaged file leaves ours alone.
+  */
+  loaded = transfer(&s, NULL, sizeof(Simulator));
+  if (loaded != NULL) {
+    clearPointers(loaded);
+    transferArrays(&s, loaded);
+  }
+
+  if (s.data && s.error == 0) {
+    const uint64_t *numbers = transfer(&s, NULL, header->Pages * sizeof(uint64_t));
+
+    for (uint64_t i = 0; i < header->Pages && s.error == 0; i++) {
+      uint64_t start = alignUp(s.offset);
+
+      if (start > s.length || DRAM_PAGE_SIZE > s.length - start) {
+        s.error = EINVAL;
+        break;
+      }
+      writeMemory(&loaded->DRAM, numbers[i] * DRAM_PAGE_SIZE, s.base + start, DRAM_PAGE_SIZE);
+      s.offset = start + DRAM_PAGE_SIZE;
+    }
+    free((void *)numbers);
+  }
+  munmap(base, s.length);
+
+  /*
+  The arrays were sized from the geometry in the file, but the accesses
+  will size them from the geometry too, and index them with the counts
+  and policy state: all of it has to hold together.
+  */
+  if (s.error == 0) {
+    if (!s.data)
+      loaded->timing_only = 1; // the caches hold no data to go with their tags
+    if (checkSimulator(loaded) < 0 || core >= loaded->core_count)
+      s.error = EINVAL;
+  }
+
+  if (s.error != 0) {
+    if (loaded != NULL) {
+      freeSimulator(loaded);
+      free(loaded);
+    }
+    errno = s.error;
+    return -1;
+  }
+
+  freeSimulator(sim);
+  memcpy(sim, loaded, sizeof(Simulator));
+  free(loaded);
+  sim->core = &sim->cores[core];
+  return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "L2_2WCache.h"
+
+/*
+Checkpoints of a whole simulator: the configuration, every cache level
+with its tags, valid, dirty and shared bits and replacement state, the
+prefetchers, victim caches, write buffers and MSHRs, the clocks and the
+statistics, and optionally the data (cache data arrays and DRAM).
+
+A checkpoint file is a CheckpointHeader, the Simulator structure with
+its pointers cleared, and then each array the pointers led to, in a
+fixed order that only depends on the configuration. Every array starts
+on a 64-byte boundary, so loading maps the file and copies the arrays
+straight into place. As the structure is stored as it is in memory, a
+checkpoint can only be loaded by a build with the same Simulator layout,
+which is what Layout checks.
+
+Taking a checkpoint after warming up lets any number of runs start
+from the same warm state, each one loading it into a simulator of its
+own.
+*/
+
+#define CHECKPOINT_MAGIC 0x31504b43 // "CKP1"
+#define CHECKPOINT_VERSION 1
+#define CHECKPOINT_ALIGN 64
+
+#define CHECKPOINT_DATA 1 // flag: the data arrays and DRAM pages are included
+
+typedef struct CheckpointHeader {
+  uint32_t Magic;
+  uint32_t Version;
+  uint64_t Layout; // sizes of the structures the checkpoint is made of
+  uint32_t Flags;
+  uint32_t Core;   // selected core
+  uint64_t Pages;  // DRAM pages, if CHECKPOINT_DATA
+  uint64_t Length; // of the whole file
+} CheckpointHeader;
+
+/*
+Writes a checkpoint of the simulator to a file, with the data if
+withData is set and the simulator isn't timing-only. Misses still in
+flight and buffered stores are saved as they are. Returns 0, or -1
+(with errno set) if the file can't be written.
+*/
+int saveCheckpoint(Simulator *, const char *, uint32_t);
+
+/*
+Replaces everything in the simulator by the checkpoint, which may be
+loaded any number of times. A checkpoint without data gives a timing-only
+simulator. Returns 0, or -1 (with errno set) if the file can't be read;
+a file that isn't a checkpoint of this build fails with EINVAL, and the
+simulator is left as it was.
+*/
+int loadCheckpoint(Simulator *, const char *);
+
+#endif
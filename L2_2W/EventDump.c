@@ -0,0 +1,98 @@
+#include "Cache.h"
+#include "Events.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Decodes an event file written by a build with EVENT_TRACE (see
+Events.h), one line per event in the order they were recorded:
+
+  Time 111; Core 0; L1 fill; Read; Set 0; Tag 0x0
+
+followed by how many events of each kind there were. With -s only the
+counts are printed.
+*/
+
+#define DUMP_CHUNK 4096 // events read at a time
+
+static const char *typeNames[EVENT_COUNT] = {"hit", "miss", "fill", "eviction", "writeback"};
+
+static const char *modeName(uint32_t mode) {
+  switch (mode) {
+  case MODE_READ:
+    return "Read";
+  case MODE_WRITE:
+    return "Write";
+  default:
+    return "Prefetch";
+  }
+}
+
+static int usage(const char *name) {
+  fprintf(stderr, "Usage: %s <event file> [-s]\n", name);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  static Event events[DUMP_CHUNK];
+  uint64_t counts[2][EVENT_COUNT] = {{0}};
+  EventHeader header;
+  uint32_t summary = 0;
+  size_t n;
+  FILE *file;
+
+  if (argc < 2 || argc > 3)
+    return usage(argv[0]);
+  if (argc == 3 && strcmp(argv[2], "-s") != 0)
+    return usage(argv[0]);
+  summary = argc == 3;
+
+  if ((file = fopen(argv[1], "rb")) == NULL) {
+    fprintf(stderr, "Could not open %s: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+  if (fread(&header, sizeof(header), 1, file) != 1 || header.Magic != EVENT_MAGIC ||
+      header.Version != EVENT_VERSION) {
+    fprintf(stderr, "%s is not an event file\n", argv[1]);
+    fclose(file);
+    return 1;
+  }
+
+  while ((n = fread(events, sizeof(Event), DUMP_CHUNK, file)) > 0) {
+    for (size_t i = 0; i < n; i++) {
+      Event *e = &events[i];
+
+      if (e->Type >= EVENT_COUNT || e->Level < 1 || e->Level > 2) {
+        fprintf(stderr, "Damaged event file %s\n", argv[1]);
+        fclose(file);
+        return 1;
+      }
+      counts[e->Level - 1][e->Type]++;
+      if (!summary)
+        printf("Time %llu; Core %u; L%u %s; %s; Set %u; Tag 0x%llx\n",
+               (unsigned long long)e->Time, e->Core, e->Level, typeNames[e->Type],
+               modeName(e->Mode), e->Set, (unsigned long long)e->Tag);
+    }
+  }
+  if (ferror(file)) {
+    fprintf(stderr, "Could not read %s: %s\n", argv[1], strerror(errno));
+    fclose(file);
+    return 1;
+  }
+  fclose(file);
+
+  if (!summary)
+    printf("\n");
+  printf("Trace level: %u\n", header.Level);
+  for (uint32_t level = 0; level < 2; level++) {
+    printf("L%u:", level + 1);
+    for (uint32_t type = 0; type < EVENT_COUNT; type++)
+      printf(" %s %llu%s", typeNames[type], (unsigned long long)counts[level][type],
+             type + 1 < EVENT_COUNT ? ";" : "\n");
+  }
+  return 0;
+}
@@ -0,0 +1,70 @@
+#include "Events.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+_Thread_local EventRing *eventRing;
+
+int startEvents(const char *path) {
+
+  EventHeader header = {EVENT_MAGIC, EVENT_VERSION, EVENT_TRACE, 0};
+  EventRing *ring;
+
+  if (eventRing != NULL) {
+    errno = EBUSY;
+    return -1;
+  }
+
+  ring = malloc(sizeof(EventRing));
+  if (ring == NULL)
+    exit(-1);
+  memset(ring, 0, offsetof(EventRing, events));
+  if ((ring->file = fopen(path, "wb")) == NULL) {
+    free(ring);
+    return -1;
+  }
+  if (fwrite(&header, sizeof(header), 1, ring->file) != 1)
+    ring->error = errno;
+
+  eventRing = ring;
+  return 0;
+}
+
+/*
+Once the file can't be written we keep recording into the ring, so
+that the run carries on as it would have; stopEvents reports it.
+*/
+static void writeEvents(EventRing *ring, uint64_t count) {
+  if (ring->error == 0 && fwrite(ring->events, sizeof(Event), count, ring->file) != count)
+    ring->error = errno;
+}
+
+void flushEvents(EventRing *ring) { writeEvents(ring, EVENT_RING_EVENTS); }
+
+int stopEvents(uint64_t *count) {
+
+  EventRing *ring = eventRing;
+  int error;
+
+  if (ring == NULL) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  writeEvents(ring, ring->head & (EVENT_RING_EVENTS - 1));
+  if (fclose(ring->file) != 0 && ring->error == 0)
+    ring->error = errno;
+  if (count != NULL)
+    *count = ring->head;
+
+  error = ring->error;
+  free(ring);
+  eventRing = NULL;
+  if (error != 0) {
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
@@ -0,0 +1,124 @@
+#ifndef EVENTS_H
+#define EVENTS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+Event tracing, for following what the caches do access by access.
+EVENT_TRACE chooses at compile time what gets recorded:
+
+  0  nothing (the default): every TRACE_EVENT compiles to nothing
+  1  misses, fills, evictions and writebacks
+  2  hits as well
+
+Events are binary records appended to a ring of the calling thread.
+Each time the ring wraps around it is written out to the thread's
+event file with a single fwrite, so a long run pays a few stores per
+event instead of a printf. EventDump turns the file into text offline.
+
+Events come from the caches an access goes through, evictions from
+the victim cache included. Copies that an inclusive L2 takes away from
+L1 (the BackInvalidations statistic) and those that another core's
+snoop invalidates or writes back (Invalidations and Interventions)
+leave no events.
+*/
+
+#ifndef EVENT_TRACE
+#define EVENT_TRACE 0
+#endif
+
+#define EVENT_MAGIC 0x31545645 // "EVT1"
+#define EVENT_VERSION 1
+#define EVENT_RING_EVENTS 65536 // per thread (1.5 MiB), a power of two
+
+#define EVENT_HIT 0
+#define EVENT_MISS 1
+#define EVENT_FILL 2      // a block placed in a line
+#define EVENT_EVICTION 3  // a valid block replaced by another
+#define EVENT_WRITEBACK 4 // an evicted block written to the next level
+#define EVENT_COUNT 5
+
+typedef struct EventHeader {
+  uint32_t Magic;
+  uint32_t Version;
+  uint32_t Level; // EVENT_TRACE of the build that wrote the file
+  uint32_t Reserved;
+} EventHeader;
+
+/*
+Tag and Set are those of the block the event is about, which for
+evictions and writebacks is the block leaving. Mode is that of the
+access that caused the event: MODE_READ, MODE_WRITE (see Cache.h) or
+2 for a prefetch. An L1 fill is a read of L2 and an L1 victim a write.
+*/
+typedef struct Event {
+  uint64_t Time; // of the core, when it happened
+  uint64_t Tag;
+  uint32_t Set;
+  uint8_t Type;  // one of the EVENT_ constants
+  uint8_t Level; // 1 or 2
+  uint8_t Core;
+  uint8_t Mode;
+} Event;
+
+typedef struct EventRing {
+  uint64_t head; // events recorded so far
+  FILE *file;
+  int error; // errno of the first failure, 0 if none
+  Event events[EVENT_RING_EVENTS];
+} EventRing;
+
+extern _Thread_local EventRing *eventRing;
+
+/*
+Starts recording the calling thread's events into path. Returns 0, or
+-1 (with errno set) if it already is or the file can't be created.
+*/
+int startEvents(const char *path);
+
+/*
+Stops recording the calling thread's events, writing out what is left
+in its ring. count (unless NULL) gets the number of events recorded.
+Returns 0, or -1 (with errno set) if there was nothing to stop or the
+file couldn't be written.
+*/
+int stopEvents(uint64_t *count);
+
+// Writes out a full ring, see recordEvent
+void flushEvents(EventRing *);
+
+static inline void recordEvent(uint32_t type, uint32_t level, uint32_t core, uint32_t mode,
+                               uint32_t set, uint64_t tag, uint64_t time) {
+
+  EventRing *ring = eventRing;
+
+  if (ring == NULL)
+    return;
+  ring->events[ring->head & (EVENT_RING_EVENTS - 1)] =
+      (Event){time, tag, set, (uint8_t)type, (uint8_t)level, (uint8_t)core, (uint8_t)mode};
+  if ((++ring->head & (EVENT_RING_EVENTS - 1)) == 0)
+    flushEvents(ring);
+}
+
+/*
+TRACE_EVENT(minimum, type, level, core, mode, set, tag, time) records
+an event if EVENT_TRACE is at least minimum. Without EVENT_TRACE the
+arguments are still compiled, so that variables kept only for events
+don't go unused, but nothing is evaluated.
+*/
+#if EVENT_TRACE > 0
+#define TRACE_EVENT(minimum, ...)                                                                  \
+  do {                                                                                             \
+    if ((minimum) <= EVENT_TRACE)                                                                  \
+      recordEvent(__VA_ARGS__);                                                                    \
+  } while (0)
+#else
+#define TRACE_EVENT(minimum, ...)                                                                  \
+  do {                                                                                             \
+    if (0)                                                                                         \
+      recordEvent(__VA_ARGS__);                                                                    \
+  } while (0)
+#endif
+
+#endif
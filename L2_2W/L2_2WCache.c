@@ -1,228 +1,2326 @@
-#include "L2_2WCache.h"
-
-// Explanation below
-#define L1_OFFSET_BITS 6
-#define L1_INDEX_BITS 8
-
-#define L2_2W_OFFSET_BITS 6
-#define L2_2W_INDEX_BITS 8
-
-uint8_t L1Cache[L1_SIZE];
-uint8_t L2Cache[L2_SIZE];
-uint8_t DRAM[DRAM_SIZE];
-uint32_t time;
-CacheL1 l1_cache;
-CacheL2 l2_cache;
-
-/**************** Time Manipulation ***************/
-void resetTime() { time = 0; }
-
-uint32_t getTime() { return time; }
-
-/****************  RAM memory (byte addressable) ***************/
-void accessDRAM(uint32_t address, uint8_t *data, uint32_t mode) {
-
-  if (address >= DRAM_SIZE - WORD_SIZE + 1)
-    exit(-1);
-
-  if (mode == MODE_READ) {
-    memcpy(data, &(DRAM[address]), BLOCK_SIZE);
-    time += DRAM_READ_TIME;
-  }
-
-  if (mode == MODE_WRITE) {
-    memcpy(&(DRAM[address]), data, BLOCK_SIZE);
-    time += DRAM_WRITE_TIME;
-  }
-}
-
-/*********************** L1 cache *************************/
-
-void initL1Cache() { l1_cache.init = 0; }
-
-void accessL1(uint32_t address, uint8_t *data, uint32_t mode) {
-
-  uint32_t index, offset, Tag, MemAddress;
-  uint8_t TempBlock[BLOCK_SIZE];
-
-  /* init cache */
-  if (l1_cache.init == 0) {
-    l1_cache.init = 1;
-    /*
-    Now that our cache has several lines, we have to init each line.
-    We set all lines as invalid and as clean.
-    */
-    for (int i = 0; i < (L1_SIZE / BLOCK_SIZE); i++) {
-      l1_cache.lines[i].Valid = 0;
-      l1_cache.lines[i].Dirty = 0;
-      l1_cache.lines[i].Tag = 0;
-    }
-  }
-
-  Tag = address >> (L1_OFFSET_BITS + L1_INDEX_BITS);
-  offset = address & ((1 << L1_OFFSET_BITS) - 1);
-  index = (address >> L1_OFFSET_BITS) & ((1 << L1_INDEX_BITS) - 1);
-
-  /*
-  We remove the offset bits so we get the exact place in memory
-  where our block is located.
-  */
-  MemAddress = address >> L1_OFFSET_BITS;
-  MemAddress = MemAddress << L1_OFFSET_BITS;
-
-  /*
-  Now we have several lines, so we must locate the matching line,
-  using the index.
-  */
-  CacheLine *Line = &l1_cache.lines[index];
-
-  /* access Cache */
-
-  if (!Line->Valid || Line->Tag != Tag) {         // if block not present - miss
-    accessL2(MemAddress, TempBlock, MODE_READ); // get new block from L2
-    if ((Line->Valid) && (Line->Dirty)) { // line has dirty block
-      MemAddress = Line->Tag << (L1_OFFSET_BITS + L1_INDEX_BITS);
-      MemAddress = MemAddress | (index << L1_OFFSET_BITS); 
-      accessL2(MemAddress, &(L1Cache[index * BLOCK_SIZE]), MODE_WRITE); // then write back old block
-    }
-    memcpy(&(L1Cache[index * BLOCK_SIZE]), TempBlock, BLOCK_SIZE);
-    Line->Valid = 1;
-    Line->Tag = Tag;
-    Line->Dirty = 0;
-  } // if miss, then replaced with the correct block
-
-  if (mode == MODE_READ) {    // read data from cache line
-    memcpy(data, &(L1Cache[index * BLOCK_SIZE + offset]), WORD_SIZE);
-    time += L1_READ_TIME;
-  }
-
-  if (mode == MODE_WRITE) { // write data from cache line
-    memcpy(&(L1Cache[index * BLOCK_SIZE + offset]), data, WORD_SIZE);
-    time += L1_WRITE_TIME;
-    Line->Dirty = 1;
-  }
-}
-
-/*********************** L2 cache *************************/
-
-void initL2Cache() { l2_cache.init = 0; }
-
-void accessL2(uint32_t address, uint8_t *data, uint32_t mode) {
-
-  uint8_t set_line; // used to identify hit line of set
-  uint32_t set_index, line_index, offset, Tag, MemAddress;
-  uint8_t TempBlock[BLOCK_SIZE];
-
-  /* init cache */
-  if (l2_cache.init == 0) {
-    l2_cache.init = 1;
-    for (int i = 0; i < (L2_SIZE / BLOCK_SIZE); i++) {
-      l2_cache.lines[i].Valid = 0;
-      l2_cache.lines[i].Dirty = 0;
-      l2_cache.lines[i].Tag = 0;
-    }
-  }
-
-  Tag = address >> (L2_2W_OFFSET_BITS + L2_2W_INDEX_BITS);
-  offset = address & ((1 << L2_2W_OFFSET_BITS) - 1);
-  set_index = (address >> L2_2W_OFFSET_BITS) & ((1 << L2_2W_INDEX_BITS) - 1);
-
-  /*
-  We remove the offset bits so we get the exact place in memory
-  where our block is located.
-  */
-  MemAddress = address >> L2_2W_OFFSET_BITS;
-  MemAddress = MemAddress << L2_2W_OFFSET_BITS;
-
-  /*
-  Our set has two lines. We can create a simple formula to organize
-  the lines in terms of indexes - 2*i if it's the first line of a set,
-  and 2*i+1 if it's the second. This ensures the sets are encapsulated
-  together.
-  */
-  CacheLine *FirstLine = &l2_cache.lines[2 * set_index];
-  CacheLine *SecondLine = &l2_cache.lines[2 * set_index + 1];
-
-  /*
-  If we get a hit on any of the lines, we don't need to get
-  anything from the DRAM, we can just read or write immediately.
-  */
-  if (FirstLine->Valid && FirstLine->Tag == Tag) {
-    // Hit - first line
-    set_line = 0;
-  }
-  else if (SecondLine->Valid && SecondLine->Tag == Tag) {
-    // Hit - second line
-    set_line = 1;
-  }
-  /*
-  If we don't get a hit on any of the lines of the set,
-  the miss is confirmed. We'll now find out in which line
-  we can place our block.
-  */
-  else { 
-    // Get block from the DRAM
-    accessDRAM(MemAddress, TempBlock, MODE_READ);
-
-    if (!FirstLine->Valid) {
-      // Miss - first line is invalid, use it
-      set_line = 0;
-    } 
-    else if (!SecondLine->Valid) {
-      // Miss - second line is invalid, use it
-      set_line = 1;
-    }
-    else {
-      /*
-      As both lines are valid, we can use the LRU policy to
-      determine which of the lines is the one where we're
-      replacing.
-      */
-      set_line = (FirstLine->Time < SecondLine->Time) ? 0:1;
-    }
-
-    /*
-    We use the same formula I mentioned above to get the exact
-    index of the line we're working with.
-    */
-    line_index = 2 * set_index + set_line;
-    CacheLine *Line = &l2_cache.lines[line_index];
-
-    if ((Line->Valid) && (Line->Dirty)) { // line has dirty block
-      MemAddress = Line->Tag << (L2_2W_OFFSET_BITS + L2_2W_INDEX_BITS);
-      MemAddress = MemAddress | (line_index << L2_2W_OFFSET_BITS); 
-      accessDRAM(MemAddress, &(L2Cache[line_index * BLOCK_SIZE]), MODE_WRITE);
-    }
-
-    memcpy(&(L2Cache[line_index * BLOCK_SIZE]), TempBlock, BLOCK_SIZE);
-    Line->Valid = 1;
-    Line->Tag = Tag;
-    Line->Dirty = 0;
-  }
-  
-  // Define the pointer again as in the hit cases it wasn't defined yet
-  line_index = 2 * set_index + set_line;
-  CacheLine *Line = &l2_cache.lines[line_index];
-
-  if (mode == MODE_READ) {
-    Line->Time = getTime();
-    memcpy(data, &(L2Cache[line_index * BLOCK_SIZE + offset]), WORD_SIZE);
-    time += L2_READ_TIME;
-  }
-
-  if (mode == MODE_WRITE) {
-    Line->Time = getTime();
-    memcpy(&(L2Cache[line_index * BLOCK_SIZE + offset]), data, WORD_SIZE);
-    Line->Dirty = 1;
-    time += L2_WRITE_TIME;
-  }
-
-}
-
-void read(uint32_t address, uint8_t *data) {
-  accessL1(address, data, MODE_READ);
-}
-
-void write(uint32_t address, uint8_t *data) {
-  accessL1(address, data, MODE_WRITE);
-}
\ No newline at end of file
+#include "L2_2WCache.h"
+#include "Capture.h"
+#include "Events.h"
+#include "TagMatch.h"
+
+/*
+Shift amounts for the default geometry in Cache.h. With 64 byte blocks
+we need 6 offset bits; 256 direct-mapped lines in L1 need 8 index bits,
+and 512 lines in 2-way sets give 256 sets in L2, so 8 index bits too.
+These fold to compile-time constants, which is what the specialized
+copies of the access code below are built with.
+*/
+#define L1_OFFSET_BITS __builtin_ctz(BLOCK_SIZE)
+#define L1_INDEX_BITS __builtin_ctz(L1_SIZE / BLOCK_SIZE / L1_WAYS)
+
+#define L2_2W_OFFSET_BITS __builtin_ctz(BLOCK_SIZE)
+#define L2_2W_INDEX_BITS __builtin_ctz(L2_SIZE / BLOCK_SIZE / L2_WAYS)
+
+#define ALWAYS_INLINE inline __attribute__((always_inline))
+
+// Number of the core accessing, for the events (see Events.h)
+#define CORE_NUMBER(sim) ((uint32_t)((sim)->core - (sim)->cores))
+
+// Internal access mode: bring a block in for the prefetcher
+#define MODE_PREFETCH 2
+
+// Internal L2 access modes: an L1 fill and a clean L1 victim (see accessL2Line)
+#define MODE_FILL 3
+#define MODE_CLEAN 4
+
+/**************** Simulator ***************/
+void initSimulator(Simulator *sim) {
+  memset(sim, 0, sizeof(*sim));
+  for (uint32_t c = 0; c < MAX_CORES; c++)
+    sim->cores[c].l1_cache.geometry =
+        (CacheGeometry){L1_SIZE, BLOCK_SIZE, L1_WAYS, 0, 0, 0, 0, POLICY_LRU};
+  sim->core = &sim->cores[0];
+  sim->core_count = 1;
+  sim->l2_cache.geometry = (CacheGeometry){L2_SIZE, BLOCK_SIZE, L2_WAYS, 0, 0, 0, 0, POLICY_LRU};
+  sim->latency = (Latencies){L1_READ_TIME, L1_WRITE_TIME, L2_READ_TIME,
+                             L2_WRITE_TIME, DRAM_READ_TIME, DRAM_WRITE_TIME, SNOOP_TIME,
+                             VICTIM_TIME};
+  sim->memory_limit = UINT64_MAX;
+}
+
+/* Forgets the misses and buffered stores in flight on a core. */
+static void emptyCore(Core *core) {
+  core->write_buffer.count = 0;
+  core->write_buffer.head = 0;
+  core->mshr_file.count = 0;
+  core->mshr_file.busyUntil = 0;
+}
+
+/**************** Time Manipulation ***************/
+void resetTime(Simulator *sim) {
+
+  // Anything in flight was timed against the old clock
+  for (uint32_t c = 0; c < sim->core_count; c++) {
+    sim->cores[c].time = 0;
+    sim->cores[c].write_buffer.portFree = 0;
+    sim->cores[c].mshr_file.count = 0;
+    sim->cores[c].mshr_file.busyUntil = 0;
+  }
+  sim->time = 0;
+  sim->busFree = 0;
+}
+
+uint64_t getTime(Simulator *sim) {
+
+  uint64_t latest = sim->time;
+
+  for (uint32_t c = 0; c < sim->core_count; c++) {
+    if (&sim->cores[c] != sim->core && sim->cores[c].time > latest)
+      latest = sim->cores[c].time;
+  }
+  return latest;
+}
+
+uint64_t getCoreTime(Simulator *sim, uint32_t core) {
+
+  if (core >= sim->core_count)
+    return 0;
+  return &sim->cores[core] == sim->core ? sim->time : sim->cores[core].time;
+}
+
+/**************** Statistics ***************/
+void getStats(Simulator *sim, Stats *stats) { *stats = sim->stats; }
+
+void resetStats(Simulator *sim) { memset(&sim->stats, 0, sizeof(sim->stats)); }
+
+static void printLevelStats(FILE *out, const char *name, const LevelStats *l) {
+
+  uint64_t accesses = l->Reads + l->Writes, misses = l->ReadMisses + l->WriteMisses;
+
+  fprintf(out, "%s reads: %llu (%llu hits, %llu misses)\n", name, (unsigned long long)l->Reads,
+          (unsigned long long)(l->Reads - l->ReadMisses), (unsigned long long)l->ReadMisses);
+  fprintf(out, "%s writes: %llu (%llu hits, %llu misses)\n", name,
+          (unsigned long long)l->Writes, (unsigned long long)(l->Writes - l->WriteMisses),
+          (unsigned long long)l->WriteMisses);
+  fprintf(out, "%s miss ratio: %.6f\n", name,
+          accesses ? (double)misses / (double)accesses : 0.0);
+  fprintf(out, "%s evictions: %llu (%llu dirty writebacks)\n", name,
+          (unsigned long long)l->Evictions, (unsigned long long)l->Writebacks);
+  fprintf(out, "%s cycles: %llu\n", name, (unsigned long long)l->Cycles);
+
+  if (l->Prefetches == 0)
+    return;
+
+  /*
+  Accuracy is the share of prefetches that got used, coverage the share
+  of would-be misses they removed, and timeliness the share of used
+  prefetches that arrived before they were needed.
+  */
+  fprintf(out, "%s prefetches: %llu (%llu useful, %llu late, %llu unused)\n", name,
+          (unsigned long long)l->Prefetches, (unsigned long long)l->UsefulPrefetches,
+          (unsigned long long)l->LatePrefetches, (unsigned long long)l->UnusedPrefetches);
+  fprintf(out, "%s prefetch accuracy: %.6f\n", name,
+          (double)l->UsefulPrefetches / (double)l->Prefetches);
+  fprintf(out, "%s prefetch coverage: %.6f\n", name,
+          (double)l->UsefulPrefetches / (double)(l->UsefulPrefetches + misses));
+  fprintf(out, "%s prefetch timeliness: %.6f\n", name,
+          l->UsefulPrefetches ? 1.0 - (double)l->LatePrefetches / (double)l->UsefulPrefetches
+                              : 0.0);
+  fprintf(out, "%s prefetch cycles: %llu (%llu stalled)\n", name,
+          (unsigned long long)l->PrefetchCycles, (unsigned long long)l->PrefetchStalls);
+}
+
+/* Data held by the caches, not counting copies (see the inclusion section below). */
+static uint64_t distinctBytes(Simulator *);
+
+void printStats(Simulator *sim, FILE *out) {
+
+  Stats *stats = &sim->stats;
+  Cache *l1 = &sim->core->l1_cache;
+  uint64_t capacity = sim->l2_cache.geometry.Size +
+                      (uint64_t)sim->core_count * (l1->geometry.Size +
+                                                   l1->victim.Entries * l1->geometry.BlockSize);
+
+  printLevelStats(out, "L1", &stats->l1);
+  if (sim->core->l1_cache.victim.Entries > 0) {
+    fprintf(out, "Victim cache hits: %llu (%llu misses)\n", (unsigned long long)stats->victim.Hits,
+            (unsigned long long)stats->victim.Misses);
+    fprintf(out, "Victim cache evictions: %llu (%llu dirty writebacks)\n",
+            (unsigned long long)stats->victim.Evictions,
+            (unsigned long long)stats->victim.Writebacks);
+    fprintf(out, "Victim cache cycles: %llu\n", (unsigned long long)stats->victim.Cycles);
+  }
+  printLevelStats(out, "L2", &stats->l2);
+  fprintf(out, "DRAM reads: %llu\n", (unsigned long long)stats->dram.Reads);
+  fprintf(out, "DRAM writes: %llu\n", (unsigned long long)stats->dram.Writes);
+  fprintf(out, "DRAM cycles: %llu\n", (unsigned long long)stats->dram.Cycles);
+  fprintf(out, "Distinct data held: %llu of %llu bytes\n", (unsigned long long)distinctBytes(sim),
+          (unsigned long long)capacity);
+
+  if (sim->inclusion == INCLUSION_INCLUSIVE)
+    fprintf(out, "Back-invalidations: %llu (%llu modified lines merged)\n",
+            (unsigned long long)stats->inclusion.BackInvalidations,
+            (unsigned long long)stats->inclusion.BackWritebacks);
+  if (sim->inclusion == INCLUSION_EXCLUSIVE)
+    fprintf(out, "Blocks moved to L1: %llu (%llu clean victims written to L2)\n",
+            (unsigned long long)stats->inclusion.Moves,
+            (unsigned long long)stats->inclusion.CleanVictims);
+
+  if (sim->core_count > 1) {
+    for (uint32_t c = 0; c < sim->core_count; c++)
+      fprintf(out, "Core %u time: %llu\n", c, (unsigned long long)getCoreTime(sim, c));
+    fprintf(out, "Bus transactions: %llu reads, %llu read-exclusives, %llu upgrades\n",
+            (unsigned long long)stats->coherence.Reads,
+            (unsigned long long)stats->coherence.ReadExclusives,
+            (unsigned long long)stats->coherence.Upgrades);
+    fprintf(out, "Bus invalidations: %llu (%llu modified lines written back)\n",
+            (unsigned long long)stats->coherence.Invalidations,
+            (unsigned long long)stats->coherence.Interventions);
+    fprintf(out, "Bus cycles: %llu (%llu waiting for the bus)\n",
+            (unsigned long long)stats->coherence.BusCycles,
+            (unsigned long long)stats->coherence.ContentionCycles);
+  }
+
+  if (sim->write_policy.BufferEntries > 0) {
+    fprintf(out, "Write buffer stores: %llu (%llu coalesced)\n",
+            (unsigned long long)stats->buffer.Stores, (unsigned long long)stats->buffer.Coalesced);
+    fprintf(out, "Write buffer drains: %llu (%llu cycles in the background)\n",
+            (unsigned long long)stats->buffer.Drains, (unsigned long long)stats->buffer.DrainCycles);
+    fprintf(out, "Write buffer stall cycles: %llu\n",
+            (unsigned long long)stats->buffer.StallCycles);
+  }
+
+  if (sim->mshrs == 0)
+    return;
+
+  // Memory-level parallelism: how many misses were outstanding on average while any was
+  fprintf(out, "MSHR misses: %llu (%llu merged, %llu prefetches dropped)\n",
+          (unsigned long long)stats->mshr.Misses, (unsigned long long)stats->mshr.Merges,
+          (unsigned long long)stats->mshr.Dropped);
+  fprintf(out, "MSHR peak outstanding: %llu of %u\n", (unsigned long long)stats->mshr.Peak,
+          sim->mshrs);
+  fprintf(out, "MSHR stall cycles: %llu\n", (unsigned long long)stats->mshr.StallCycles);
+  fprintf(out, "Memory-level parallelism: %.6f\n",
+          stats->mshr.BusyCycles
+              ? (double)stats->mshr.MissCycles / (double)stats->mshr.BusyCycles
+              : 0.0);
+}
+
+/*
+Work done off the critical path (write buffer drains, prefetches and
+misses overlapped by MSHRs) goes through the normal access code, which
+charges time and cycles as it goes. beginBackground remembers where
+they were and endBackground puts them back, returning how long the
+work took.
+*/
+#define BACKGROUND_COUNTERS 10
+
+typedef struct Background {
+  uint64_t time;
+  uint64_t *counters[BACKGROUND_COUNTERS];
+  uint64_t saved[BACKGROUND_COUNTERS];
+} Background;
+
+static void beginBackground(Simulator *sim, Background *bg) {
+
+  Stats *stats = &sim->stats;
+  uint64_t **c = bg->counters;
+
+  // Every cycle count that adds up to the time
+  c[0] = &stats->l1.Cycles;
+  c[1] = &stats->l2.Cycles;
+  c[2] = &stats->dram.Cycles;
+  c[3] = &stats->buffer.StallCycles;
+  c[4] = &stats->l1.PrefetchStalls;
+  c[5] = &stats->l2.PrefetchStalls;
+  c[6] = &stats->mshr.StallCycles;
+  c[7] = &stats->coherence.BusCycles;
+  c[8] = &stats->coherence.ContentionCycles;
+  c[9] = &stats->victim.Cycles;
+
+  bg->time = sim->time;
+  for (uint32_t i = 0; i < BACKGROUND_COUNTERS; i++)
+    bg->saved[i] = *c[i];
+}
+
+static uint64_t endBackground(Simulator *sim, Background *bg) {
+
+  uint64_t cost = sim->time - bg->time;
+
+  sim->time = bg->time;
+  for (uint32_t i = 0; i < BACKGROUND_COUNTERS; i++)
+    *bg->counters[i] = bg->saved[i];
+  return cost;
+}
+
+/****************  RAM memory (byte addressable) ***************/
+void accessDRAM(Simulator *sim, uint64_t address, uint8_t *data, uint32_t mode) {
+
+  // Only L2 talks to the DRAM, so transfers are L2 blocks
+  uint32_t blockSize = sim->l2_cache.geometry.BlockSize;
+
+  /*
+  In timing-only mode no data is passed down, so no DRAM page is ever
+  allocated. Range checks happen in read() and write(), before the
+  access gets anywhere near here.
+  */
+  if (mode == MODE_READ) {
+    if (data != NULL)
+      readMemory(&sim->DRAM, address, data, blockSize);
+    sim->time += sim->latency.DRAMRead;
+    sim->stats.dram.Reads++;
+    sim->stats.dram.Cycles += sim->latency.DRAMRead;
+  }
+
+  if (mode == MODE_WRITE) {
+    if (data != NULL)
+      writeMemory(&sim->DRAM, address, data, blockSize);
+    sim->time += sim->latency.DRAMWrite;
+    sim->stats.dram.Writes++;
+    sim->stats.dram.Cycles += sim->latency.DRAMWrite;
+  }
+}
+
+/*********************** Geometry *************************/
+
+static int isPowerOfTwo(uint32_t x) { return x != 0 && (x & (x - 1)) == 0; }
+
+/*
+Checks the user-chosen fields of a geometry and fills in the derived
+ones. Returns -1 if the geometry can't be simulated.
+*/
+static int deriveGeometry(CacheGeometry *g) {
+
+  if (!isPowerOfTwo(g->Size) || !isPowerOfTwo(g->BlockSize) || !isPowerOfTwo(g->Ways))
+    return -1;
+
+  if (g->BlockSize < WORD_SIZE || g->BlockSize > MAX_BLOCK_SIZE ||
+      g->Size / g->BlockSize < g->Ways || g->Ways > MAX_WAYS || g->Policy >= POLICY_COUNT)
+    return -1;
+
+  g->Lines = g->Size / g->BlockSize;
+  g->Sets = g->Lines / g->Ways;
+  g->OffsetBits = __builtin_ctz(g->BlockSize);
+  g->IndexBits = __builtin_ctz(g->Sets);
+  return 0;
+}
+
+static const char *policyNames[POLICY_COUNT] = {"lru", "plru", "nru", "srrip", "brrip",
+                                                "random"};
+
+int parsePolicy(const char *name) {
+
+  for (int policy = 0; policy < POLICY_COUNT; policy++) {
+    if (strcmp(name, policyNames[policy]) == 0)
+      return policy;
+  }
+  return -1;
+}
+
+const char *policyName(uint32_t policy) {
+  return policy < POLICY_COUNT ? policyNames[policy] : "unknown";
+}
+
+static void freePrefetcher(Cache *cache) {
+
+  Prefetcher *p = &cache->prefetcher;
+
+  free(p->strides);
+  free(p->streams);
+  free(p->blocks);
+  free(p->ready);
+  free(p->data);
+  free(cache->prefetchedBits);
+  free(cache->ready);
+  *p = (Prefetcher){.config = p->config};
+  cache->prefetchedBits = NULL;
+  cache->ready = NULL;
+}
+
+static void freeCache(Cache *cache) {
+  freePrefetcher(cache);
+  free(cache->tags);
+  free(cache->replacement.state);
+  free(cache->validBits);
+  free(cache->dirtyBits);
+  free(cache->sharedBits);
+  free(cache->data);
+  free(cache->victim.data);
+}
+
+void freeSimulator(Simulator *sim) {
+  for (uint32_t c = 0; c < MAX_CORES; c++) {
+    freeCache(&sim->cores[c].l1_cache);
+    free(sim->cores[c].write_buffer.entries);
+  }
+  freeCache(&sim->l2_cache);
+  freeMemory(&sim->DRAM);
+  initSimulator(sim);
+}
+
+/*
+Allocates a zeroed array starting on a host cache line, so that a set's
+tags (up to 8 ways) or a bitmap word never straddle two host lines.
+*/
+static void *allocAligned(size_t bytes) {
+
+  void *p;
+
+  bytes = (bytes + 63) & ~(size_t)63; // aligned_alloc wants a multiple of 64
+  p = aligned_alloc(64, bytes);
+  if (p == NULL)
+    exit(-1);
+  memset(p, 0, bytes);
+  return p;
+}
+
+int configureCaches(Simulator *sim, const CacheGeometry *l1, const CacheGeometry *l2) {
+
+  CacheGeometry g1 = *l1, g2 = *l2;
+
+  if (deriveGeometry(&g1) < 0 || deriveGeometry(&g2) < 0)
+    return -1;
+
+  // An L1 block has to fit inside the L2 block it's fetched from
+  if (g1.BlockSize > g2.BlockSize)
+    return -1;
+  if (sim->inclusion == INCLUSION_EXCLUSIVE && g1.BlockSize != g2.BlockSize)
+    return -1;
+
+  for (uint32_t c = 0; c < MAX_CORES; c++) {
+    Cache *l1_cache = &sim->cores[c].l1_cache;
+    freeCache(l1_cache);
+    *l1_cache = (Cache){.geometry = g1,
+                        .prefetcher.config = l1_cache->prefetcher.config,
+                        .victim.Entries = l1_cache->victim.Entries};
+    emptyCore(&sim->cores[c]); // buffered blocks belong to the old caches
+  }
+  freeCache(&sim->l2_cache);
+  sim->l2_cache = (Cache){.geometry = g2, .prefetcher.config = sim->l2_cache.prefetcher.config};
+  return 0;
+}
+
+void setTimingOnly(Simulator *sim, uint32_t enabled) {
+
+  sim->timing_only = enabled != 0;
+
+  /*
+  Data arrays are (re)allocated by setupCache only when needed, so
+  here we just drop them and make both levels start again empty.
+  */
+  for (uint32_t c = 0; c < MAX_CORES; c++) {
+    Cache *l1_cache = &sim->cores[c].l1_cache;
+    if (sim->timing_only) {
+      free(l1_cache->data);
+      free(l1_cache->prefetcher.data);
+      free(l1_cache->victim.data);
+      l1_cache->data = NULL;
+      l1_cache->prefetcher.data = NULL;
+      l1_cache->victim.data = NULL;
+    }
+    l1_cache->init = 0;
+    emptyCore(&sim->cores[c]);
+  }
+
+  if (sim->timing_only) {
+    free(sim->l2_cache.data);
+    free(sim->l2_cache.prefetcher.data);
+    freeMemory(&sim->DRAM);
+    sim->l2_cache.data = NULL;
+    sim->l2_cache.prefetcher.data = NULL;
+  }
+  sim->l2_cache.init = 0;
+}
+
+int setCores(Simulator *sim, uint32_t count) {
+
+  if (count == 0 || count > MAX_CORES)
+    return -1;
+
+  sim->core->time = sim->time;
+  for (uint32_t c = 0; c < MAX_CORES; c++) {
+    sim->cores[c].l1_cache.init = 0;
+    emptyCore(&sim->cores[c]);
+    sim->cores[c].time = sim->core->time;
+  }
+  sim->core_count = count;
+  sim->core = &sim->cores[0];
+  return 0;
+}
+
+int selectCore(Simulator *sim, uint32_t core) {
+
+  if (core >= sim->core_count)
+    return -1;
+
+  sim->core->time = sim->time;
+  sim->core = &sim->cores[core];
+  sim->time = sim->core->time;
+  return 0;
+}
+
+void setMemorySize(Simulator *sim, uint64_t bytes) {
+  sim->memory_limit = bytes ? bytes - 1 : UINT64_MAX;
+}
+
+/* Whether the word at address lies inside the simulated memory. */
+static inline uint32_t inMemory(Simulator *sim, uint64_t address) {
+  return sim->memory_limit >= WORD_SIZE - 1 && address <= sim->memory_limit - (WORD_SIZE - 1);
+}
+
+/* Allocates (if needed) and empties the prefetcher state of a level. */
+static void setupPrefetcher(Simulator *sim, Cache *cache, size_t bitmapWords) {
+
+  Prefetcher *p = &cache->prefetcher;
+  CacheGeometry *g = &cache->geometry;
+  size_t slots = (size_t)p->config.Entries * p->config.Degree;
+
+  switch (p->config.Type) {
+  case PREFETCH_NEXT_LINE:
+  case PREFETCH_STRIDE:
+    if (cache->prefetchedBits == NULL) {
+      cache->prefetchedBits = allocAligned(bitmapWords * sizeof(uint64_t));
+      cache->ready = allocAligned(g->Lines * sizeof(uint64_t));
+    }
+    memset(cache->prefetchedBits, 0, bitmapWords * sizeof(uint64_t));
+    if (p->config.Type == PREFETCH_STRIDE) {
+      if (p->strides == NULL)
+        p->strides = allocAligned(p->config.Entries * sizeof(StrideEntry));
+      memset(p->strides, 0, p->config.Entries * sizeof(StrideEntry));
+    }
+    break;
+  case PREFETCH_STREAM:
+    if (p->streams == NULL) {
+      p->streams = allocAligned(p->config.Entries * sizeof(StreamBuffer));
+      p->blocks = allocAligned(slots * sizeof(uint64_t));
+      p->ready = allocAligned(slots * sizeof(uint64_t));
+    }
+    if (p->data == NULL && !sim->timing_only)
+      p->data = allocAligned(slots * g->BlockSize);
+    memset(p->streams, 0, p->config.Entries * sizeof(StreamBuffer));
+    break;
+  }
+  p->clock = 0;
+}
+
+/*
+Lazily allocates a level and sets all its lines as invalid and clean.
+The fixed flag tells the access functions whether they can use the
+copy of their code specialized for the default geometry.
+*/
+static void setupCache(Simulator *sim, Cache *cache, uint32_t offsetBits, uint32_t indexBits,
+                       uint32_t ways) {
+
+  CacheGeometry *g = &cache->geometry;
+  Replacement *r = &cache->replacement;
+  size_t bitmapWords;
+
+  if (deriveGeometry(g) < 0)
+    exit(-1);
+
+  bitmapWords = (g->Lines + 63) / 64;
+
+  if (cache->tags == NULL) {
+    cache->tags = allocAligned((g->Lines + TAG_PADDING) * sizeof(uint64_t));
+    r->Policy = g->Policy;
+    r->Words = replacementWords(g->Policy, g->Ways);
+    r->state = allocAligned((size_t)g->Sets * r->Words * sizeof(uint64_t));
+    cache->validBits = allocAligned(bitmapWords * sizeof(uint64_t));
+    cache->dirtyBits = allocAligned(bitmapWords * sizeof(uint64_t));
+    cache->sharedBits = allocAligned(bitmapWords * sizeof(uint64_t));
+  }
+
+  if (cache->data == NULL && !sim->timing_only)
+    cache->data = allocAligned(g->Size);
+
+  memset(cache->validBits, 0, bitmapWords * sizeof(uint64_t));
+  memset(cache->dirtyBits, 0, bitmapWords * sizeof(uint64_t));
+  memset(cache->sharedBits, 0, bitmapWords * sizeof(uint64_t));
+  for (uint32_t set = 0; set < g->Sets; set++)
+    resetSet(r, &r->state[set * r->Words], g->Ways);
+  r->clock = 0;
+  r->seed = 0x9e3779b97f4a7c15ULL; // any nonzero seed, fixed so runs repeat
+
+  if (cache->victim.data == NULL && cache->victim.Entries > 0 && !sim->timing_only)
+    cache->victim.data = allocAligned((size_t)cache->victim.Entries * g->BlockSize);
+  cache->victim.valid = cache->victim.dirty = cache->victim.shared = 0;
+  cache->victim.clock = 0;
+
+  setupPrefetcher(sim, cache, bitmapWords);
+
+  cache->fixed = g->OffsetBits == offsetBits && g->IndexBits == indexBits && g->Ways == ways;
+  cache->init = 1;
+}
+
+static ALWAYS_INLINE uint32_t isValid(Cache *cache, uint32_t line_index) {
+  return (cache->validBits[line_index / 64] >> (line_index % 64)) & 1;
+}
+
+static ALWAYS_INLINE void setValid(Cache *cache, uint32_t line_index) {
+  cache->validBits[line_index / 64] |= 1ULL << (line_index % 64);
+}
+
+static ALWAYS_INLINE uint32_t isDirty(Cache *cache, uint32_t line_index) {
+  return (cache->dirtyBits[line_index / 64] >> (line_index % 64)) & 1;
+}
+
+static ALWAYS_INLINE void setDirty(Cache *cache, uint32_t line_index) {
+  cache->dirtyBits[line_index / 64] |= 1ULL << (line_index % 64);
+}
+
+static ALWAYS_INLINE void clearDirty(Cache *cache, uint32_t line_index) {
+  cache->dirtyBits[line_index / 64] &= ~(1ULL << (line_index % 64));
+}
+
+static ALWAYS_INLINE void clearValid(Cache *cache, uint32_t line_index) {
+  cache->validBits[line_index / 64] &= ~(1ULL << (line_index % 64));
+}
+
+static ALWAYS_INLINE uint32_t isShared(Cache *cache, uint32_t line_index) {
+  return (cache->sharedBits[line_index / 64] >> (line_index % 64)) & 1;
+}
+
+static ALWAYS_INLINE void setShared(Cache *cache, uint32_t line_index, uint32_t shared) {
+  cache->sharedBits[line_index / 64] &= ~(1ULL << (line_index % 64));
+  cache->sharedBits[line_index / 64] |= (uint64_t)shared << (line_index % 64);
+}
+
+/*
+Looks for Tag in set set_index. The vectorized tag comparison ANDed
+with the valid bits gives the hit way, and the complement of the valid
+bits gives the first invalid way. On a hit, *hit is set and the
+matching way is returned. On a miss we return where the new block
+should go: the first invalid way, or else the replacement policy's
+victim.
+
+Ways is a power of two no larger than 64, so a set's valid bits sit in
+a single word.
+*/
+static ALWAYS_INLINE uint32_t lookupSet(Cache *cache, uint32_t set_index, uint32_t ways,
+                                        uint64_t Tag, uint32_t *hit) {
+
+  uint32_t first = set_index * ways;
+  uint64_t valid, match;
+  Replacement *r = &cache->replacement;
+
+  valid = (cache->validBits[first / 64] >> (first % 64)) & lowMask(ways);
+  match = matchTags(&cache->tags[first], ways, Tag) & valid;
+
+  *hit = match != 0;
+  if (match)
+    return __builtin_ctzll(match);
+
+  if (valid != lowMask(ways))
+    return __builtin_ctzll(~valid);
+
+  return victimLine(r, &r->state[set_index * r->Words], ways);
+}
+
+/* Updates the policy state of a set after an access to set_line. */
+static ALWAYS_INLINE void updatePolicy(Cache *cache, uint32_t set_index, uint32_t ways,
+                                       uint32_t set_line, uint32_t hit) {
+
+  Replacement *r = &cache->replacement;
+  uint64_t *set = &r->state[set_index * r->Words];
+
+  if (hit)
+    touchLine(r, set, ways, set_line);
+  else
+    fillLine(r, set, ways, set_line);
+}
+
+/*********************** Prefetch bookkeeping *************************/
+
+static ALWAYS_INLINE uint32_t isPrefetched(Cache *cache, uint32_t line_index) {
+  return (cache->prefetchedBits[line_index / 64] >> (line_index % 64)) & 1;
+}
+
+static ALWAYS_INLINE void setPrefetched(Cache *cache, uint32_t line_index, uint32_t prefetched) {
+  cache->prefetchedBits[line_index / 64] &= ~(1ULL << (line_index % 64));
+  cache->prefetchedBits[line_index / 64] |= (uint64_t)prefetched << (line_index % 64);
+}
+
+/*
+A demand access uses a prefetched block that arrives at time ready,
+waiting for it if it isn't there yet and wait is set (a non-blocking
+L1 doesn't wait, the access is merged into the prefetch's MSHR).
+*/
+static void usePrefetch(Simulator *sim, LevelStats *stats, uint64_t ready, uint32_t wait) {
+
+  stats->UsefulPrefetches++;
+  if (ready > sim->time)
+    stats->LatePrefetches++;
+  if (ready > sim->time && wait) {
+    stats->PrefetchStalls += ready - sim->time;
+    sim->time = ready;
+  }
+}
+
+/* The line of the cache holding the block at address, or -1, without touching any state. */
+static int64_t findLine(Cache *cache, uint64_t address) {
+
+  CacheGeometry *g = &cache->geometry;
+  uint32_t set_index = (uint32_t)(address >> g->OffsetBits) & (g->Sets - 1);
+  uint32_t first = set_index * g->Ways;
+  uint64_t valid = (cache->validBits[first / 64] >> (first % 64)) & lowMask(g->Ways);
+  uint64_t match =
+      matchTags(&cache->tags[first], g->Ways, address >> (g->OffsetBits + g->IndexBits)) & valid;
+
+  return match ? (int64_t)first + __builtin_ctzll(match) : -1;
+}
+
+/* The entry of a victim cache holding block, or -1. */
+static int32_t findVictim(VictimCache *v, uint64_t block) {
+
+  for (uint32_t e = 0; e < v->Entries; e++) {
+    if (((v->valid >> e) & 1) && v->blocks[e] == block)
+      return (int32_t)e;
+  }
+  return -1;
+}
+
+/* Whether the level has the block at address, in its victim cache counting as having it. */
+static uint32_t containsBlock(Cache *cache, uint64_t address) {
+  return findLine(cache, address) >= 0 ||
+         (cache->victim.Entries > 0 &&
+          findVictim(&cache->victim, address >> cache->geometry.OffsetBits) >= 0);
+}
+
+/*
+Looks for block in the stream buffers. If buffer *s has it, *i blocks
+from its head, we return 1.
+*/
+static uint32_t findStream(Prefetcher *p, uint64_t block, uint32_t *s, uint32_t *i) {
+
+  uint32_t degree = p->config.Degree;
+
+  for (*s = 0; *s < p->config.Entries; (*s)++) {
+    StreamBuffer *stream = &p->streams[*s];
+    for (*i = 0; *i < stream->count; (*i)++) {
+      if (p->blocks[*s * degree + (stream->head + *i) % degree] == block)
+        return 1;
+    }
+  }
+  return 0;
+}
+
+static uint32_t inStreams(Prefetcher *p, uint64_t block) {
+
+  uint32_t s, i;
+
+  return findStream(p, block, &s, &i);
+}
+
+/*
+Takes block out of stream buffer s, along with every block queued
+before it, which will now never be used. Returns its slot.
+*/
+static uint32_t removeStream(Prefetcher *p, LevelStats *stats, uint32_t s, uint32_t i) {
+
+  StreamBuffer *stream = &p->streams[s];
+  uint32_t degree = p->config.Degree, slot = s * degree + (stream->head + i) % degree;
+
+  stats->UnusedPrefetches += i;
+  stream->head = (stream->head + i + 1) % degree;
+  stream->count -= i + 1;
+  return slot;
+}
+
+/*
+Looks for block in the stream buffers. If one has it, the block is
+copied to data (unless NULL) and taken out.
+*/
+static uint32_t takeStream(Simulator *sim, Cache *cache, LevelStats *stats, uint64_t block,
+                           uint8_t *data, uint32_t wait) {
+
+  Prefetcher *p = &cache->prefetcher;
+  uint32_t blockSize = cache->geometry.BlockSize, s, i, slot;
+
+  if (!findStream(p, block, &s, &i))
+    return 0;
+
+  slot = removeStream(p, stats, s, i);
+  if (data != NULL)
+    memcpy(data, &p->data[(size_t)slot * blockSize], blockSize);
+  p->streams[s].LastUse = ++p->clock;
+  p->last = s;
+  usePrefetch(sim, stats, p->ready[slot], wait);
+  return 1;
+}
+
+/*********************** MSHRs *************************/
+
+/* Frees the MSHRs whose miss has completed by now. */
+static void retireMisses(Simulator *sim) {
+
+  MSHRFile *f = &sim->core->mshr_file;
+  uint32_t kept = 0;
+
+  for (uint32_t i = 0; i < f->count; i++) {
+    if (f->entries[i].Completes > sim->time)
+      f->entries[kept++] = f->entries[i];
+  }
+  f->count = kept;
+}
+
+/* Makes sure an MSHR is free, waiting for the first one to complete if need be. */
+static void reserveMSHR(Simulator *sim) {
+
+  MSHRFile *f = &sim->core->mshr_file;
+  uint64_t first = UINT64_MAX;
+
+  retireMisses(sim);
+  if (f->count < sim->mshrs)
+    return;
+
+  for (uint32_t i = 0; i < f->count; i++) {
+    if (f->entries[i].Completes < first)
+      first = f->entries[i].Completes;
+  }
+  sim->stats.mshr.StallCycles += first - sim->time;
+  sim->time = first;
+  retireMisses(sim);
+}
+
+/* Takes an MSHR for a miss to block issued now and taking latency cycles. */
+static void recordMiss(Simulator *sim, uint64_t block, uint64_t latency) {
+
+  MSHRFile *f = &sim->core->mshr_file;
+  MissStats *stats = &sim->stats.mshr;
+  uint64_t completes = sim->time + latency;
+  uint64_t from = f->busyUntil > sim->time ? f->busyUntil : sim->time;
+
+  f->entries[f->count++] = (MSHR){block, sim->time, completes};
+  stats->Misses++;
+  stats->MissCycles += latency;
+  stats->BusyCycles += completes > from ? completes - from : 0;
+  if (completes > f->busyUntil)
+    f->busyUntil = completes;
+  if (f->count > stats->Peak)
+    stats->Peak = f->count;
+}
+
+/* Counts an access to block as merged if its miss is still outstanding. */
+static void mergeMiss(Simulator *sim, uint64_t block) {
+
+  MSHRFile *f = &sim->core->mshr_file;
+
+  for (uint32_t i = 0; i < f->count; i++) {
+    if (f->entries[i].Block == block && f->entries[i].Completes > sim->time) {
+      sim->stats.mshr.Merges++;
+      return;
+    }
+  }
+}
+
+int setMSHRs(Simulator *sim, uint32_t count) {
+
+  if (count > MAX_MSHRS)
+    return -1;
+
+  waitForMisses(sim);
+  sim->mshrs = count;
+  return 0;
+}
+
+void waitForMisses(Simulator *sim) {
+
+  // Every core waits for its own misses, on its own clock
+  sim->core->time = sim->time;
+  for (uint32_t c = 0; c < sim->core_count; c++) {
+    Core *core = &sim->cores[c];
+    MSHRFile *f = &core->mshr_file;
+
+    if (f->busyUntil > core->time && f->count > 0) {
+      sim->stats.mshr.StallCycles += f->busyUntil - core->time;
+      core->time = f->busyUntil;
+    }
+    f->count = 0;
+  }
+  sim->time = sim->core->time;
+}
+
+/*
+How L1 reaches L2 (see the write buffer section below): fetchFromL2
+reads the L1 block at address, for an L1 fill if its last argument is
+set, and returns whether the block arrives dirty. sendToL2 writes
+length bytes at address, going through the write buffer if there is
+one, and evictToL2 hands over a line L1 gives up, dirty or not.
+*/
+static uint32_t fetchFromL2(Simulator *, uint64_t, uint8_t *, uint32_t);
+static void sendToL2(Simulator *, uint64_t, const uint8_t *, uint32_t);
+static void evictToL2(Simulator *, uint64_t, const uint8_t *, uint32_t);
+
+/*
+Trains the prefetcher of a level with a demand access to block and
+issues what it asks for (see the prefetching section below). missed
+tells whether the access missed everywhere in that level.
+*/
+static void issuePrefetches(Simulator *, Cache *, LevelStats *, uint64_t, uint32_t);
+
+/*
+Puts a transaction of the running core for the L1 block at address on
+the bus (see the coherence section below). Returns whether another L1
+still holds the block afterwards.
+*/
+static uint32_t busTransaction(Simulator *, uint64_t, uint32_t);
+
+/*
+Drops the L1 copies of the block at address that an inclusive L2 is
+evicting (see the inclusion section below), merging modified ones into
+the L2 line's data. Returns whether there were any.
+*/
+static uint32_t backInvalidate(Simulator *, uint64_t, uint8_t *);
+
+/*********************** Victim cache *************************/
+
+int setVictimCache(Simulator *sim, uint32_t count) {
+
+  if (count > MAX_VICTIMS)
+    return -1;
+
+  for (uint32_t c = 0; c < MAX_CORES; c++) {
+    VictimCache *v = &sim->cores[c].l1_cache.victim;
+    free(v->data);
+    v->data = NULL;
+    v->Entries = count;
+    sim->cores[c].l1_cache.init = 0;
+  }
+  return 0;
+}
+
+/*
+An L1 miss found its block in entry e of the victim cache: the block
+is copied to data (unless NULL) and the entry freed for the line L1
+evicts in exchange. *dirty and *shared get the bits the block had.
+*/
+static void takeVictim(Simulator *sim, Cache *cache, uint32_t e, uint8_t *data, uint32_t *dirty,
+                       uint32_t *shared) {
+
+  VictimCache *v = &cache->victim;
+  uint32_t blockSize = cache->geometry.BlockSize;
+
+  if (data != NULL)
+    memcpy(data, &v->data[(size_t)e * blockSize], blockSize);
+  *dirty = (v->dirty >> e) & 1;
+  *shared = (v->shared >> e) & 1;
+  v->valid &= ~(1ULL << e);
+
+  sim->time += sim->latency.Victim;
+  sim->stats.victim.Hits++;
+  sim->stats.victim.Cycles += sim->latency.Victim;
+}
+
+/*
+Puts the line L1 just evicted, the block at address, in the victim
+cache. If every entry is taken the oldest one makes room, going to L2
+if it is dirty. mode is that of the access that evicted the line.
+*/
+static void putVictim(Simulator *sim, Cache *cache, uint64_t address, const uint8_t *data,
+                      uint32_t dirty, uint32_t shared, uint32_t mode) {
+
+  VictimCache *v = &cache->victim;
+  uint32_t blockSize = cache->geometry.BlockSize, offsetBits = cache->geometry.OffsetBits, e = 0;
+  uint32_t indexBits = cache->geometry.IndexBits;
+  uint64_t block;
+  uint8_t *slot;
+
+  if (v->valid != wayMask(v->Entries)) {
+    e = __builtin_ctzll(~v->valid);
+  } else {
+    for (uint32_t i = 1; i < v->Entries; i++) {
+      if (v->stamps[i] < v->stamps[e])
+        e = i;
+    }
+    block = v->blocks[e];
+    sim->stats.victim.Evictions++;
+    sim->stats.victim.Writebacks += (v->dirty >> e) & 1;
+    TRACE_EVENT(1, EVENT_EVICTION, 1, CORE_NUMBER(sim), mode,
+                (uint32_t)block & ((1 << indexBits) - 1), block >> indexBits, sim->time);
+    if ((v->dirty >> e) & 1)
+      TRACE_EVENT(1, EVENT_WRITEBACK, 1, CORE_NUMBER(sim), mode,
+                  (uint32_t)block & ((1 << indexBits) - 1), block >> indexBits, sim->time);
+    evictToL2(sim, block << offsetBits, v->data ? &v->data[(size_t)e * blockSize] : NULL,
+              (v->dirty >> e) & 1);
+  }
+
+  slot = v->data ? &v->data[(size_t)e * blockSize] : NULL;
+  if (slot != NULL && data != NULL)
+    memcpy(slot, data, blockSize);
+  v->blocks[e] = address >> offsetBits;
+  v->stamps[e] = ++v->clock;
+  v->valid |= 1ULL << e;
+  v->dirty = (v->dirty & ~(1ULL << e)) | (uint64_t)dirty << e;
+  v->shared = (v->shared & ~(1ULL << e)) | (uint64_t)shared << e;
+}
+
+/*********************** L1 cache *************************/
+
+void initL1Cache(Simulator *sim) {
+  for (uint32_t c = 0; c < sim->core_count; c++)
+    sim->cores[c].l1_cache.init = 0;
+}
+
+static ALWAYS_INLINE void accessL1Line(Simulator *sim, uint64_t address, uint8_t *data,
+                                       uint32_t mode, uint32_t offsetBits, uint32_t indexBits,
+                                       uint32_t ways, uint32_t withData) {
+
+  uint32_t hit, set_line, set_index, line_index, offset;
+  uint64_t Tag, MemAddress;
+  uint32_t blockSize = 1 << offsetBits;
+  uint8_t TempBlock[MAX_BLOCK_SIZE];
+  LevelStats *stats = &sim->stats.l1;
+  Cache *cache = &sim->core->l1_cache;
+  uint32_t prefetcher = cache->prefetcher.config.Type, trigger = 0, fromStream = 0;
+  uint32_t blocking = sim->mshrs == 0, overlap, shared = 0;
+  uint32_t coherent = sim->core_count > 1, exclusive = sim->inclusion == INCLUSION_EXCLUSIVE;
+  uint32_t fromVictim = 0, dirty = 0;
+  int32_t entry = -1;
+  Background bg;
+
+  Tag = address >> (offsetBits + indexBits);
+  offset = (uint32_t)address & (blockSize - 1);
+  set_index = (uint32_t)(address >> offsetBits) & ((1 << indexBits) - 1);
+
+  /*
+  We remove the offset bits so we get the exact place in memory
+  where our block is located.
+  */
+  MemAddress = address >> offsetBits;
+  MemAddress = MemAddress << offsetBits;
+
+  /*
+  The lines of a set are stored next to each other, so line
+  set_index * ways + set_line is line set_line of set set_index.
+  */
+  set_line = lookupSet(cache, set_index, ways, Tag, &hit);
+  line_index = set_index * ways + set_line;
+  uint8_t *Block = withData ? &cache->data[line_index * blockSize] : NULL;
+
+  /* access Cache */
+
+  if (hit && mode == MODE_PREFETCH) // nothing to bring in
+    return;
+  TRACE_EVENT(hit ? 2 : 1, hit ? EVENT_HIT : EVENT_MISS, 1, CORE_NUMBER(sim), mode, set_index,
+              Tag, sim->time);
+
+  /*
+  The first demand hit on a prefetched line is what makes the prefetch
+  useful, and it keeps the prefetcher going. A miss may still find its
+  block in the victim cache or a stream buffer.
+  */
+  if (hit && cache->prefetchedBits != NULL && isPrefetched(cache, line_index)) {
+    setPrefetched(cache, line_index, 0);
+    usePrefetch(sim, stats, cache->ready[line_index], blocking);
+    trigger = 1;
+  }
+  if (!hit && cache->victim.Entries > 0) {
+    entry = findVictim(&cache->victim, MemAddress >> offsetBits);
+    fromVictim = entry >= 0;
+    sim->stats.victim.Misses += !fromVictim;
+  }
+  if (!hit && !fromVictim && prefetcher == PREFETCH_STREAM)
+    fromStream = trigger = takeStream(sim, cache, stats, MemAddress >> offsetBits,
+                                      withData ? TempBlock : NULL, blocking);
+  if (hit && sim->core->mshr_file.count > 0)
+    mergeMiss(sim, MemAddress >> offsetBits);
+
+  /*
+  Without write-allocate a store miss leaves L1 alone and the word goes
+  on to L2 (or the write buffer). A block waiting in the victim cache
+  or a stream buffer is taken in instead, so that neither ever holds a
+  stale copy.
+  */
+  if (!hit && !fromStream && !fromVictim && mode == MODE_WRITE &&
+      sim->write_policy.NoWriteAllocate) {
+    stats->WriteMisses++;
+    if (coherent) {
+      sim->stats.coherence.ReadExclusives++;
+      busTransaction(sim, MemAddress, 1);
+    }
+    sendToL2(sim, address, withData ? data : NULL, WORD_SIZE);
+    sim->time += sim->latency.L1Write;
+    stats->Writes++;
+    stats->Cycles += sim->latency.L1Write;
+    return;
+  }
+
+  if (!hit) {                                   // if block not present - miss
+    stats->ReadMisses += mode == MODE_READ && !fromStream;
+    stats->WriteMisses += mode == MODE_WRITE && !fromStream;
+    stats->Evictions += isValid(cache, line_index);
+    if (cache->prefetchedBits != NULL) {
+      stats->UnusedPrefetches += isValid(cache, line_index) && isPrefetched(cache, line_index);
+      setPrefetched(cache, line_index, mode == MODE_PREFETCH);
+    }
+
+    /*
+    A non-blocking L1 issues the miss, victim writeback included, and
+    carries on; only its MSHR remembers how long it takes.
+    */
+    overlap = !blocking && !fromStream && !fromVictim && mode != MODE_PREFETCH;
+    if (overlap) {
+      reserveMSHR(sim);
+      beginBackground(sim, &bg);
+    }
+
+    /*
+    The other L1s hear about every fill, even one from a stream buffer,
+    but not about one from our own victim cache: the block never left.
+    */
+    if (coherent && !fromVictim) {
+      sim->stats.coherence.Reads += mode != MODE_WRITE;
+      sim->stats.coherence.ReadExclusives += mode == MODE_WRITE;
+      shared = busTransaction(sim, MemAddress, mode == MODE_WRITE);
+    }
+
+    if (fromVictim)
+      takeVictim(sim, cache, (uint32_t)entry, withData ? TempBlock : NULL, &dirty, &shared);
+    else if (!fromStream)
+      dirty = fetchFromL2(sim, MemAddress, withData ? TempBlock : NULL, 1); // get new block from L2
+
+    if (isValid(cache, line_index))
+      TRACE_EVENT(1, EVENT_EVICTION, 1, CORE_NUMBER(sim), mode, set_index, cache->tags[line_index],
+                  sim->time);
+
+    // The old block goes to the victim cache if there is one, dirty or not
+    if (isValid(cache, line_index) && cache->victim.Entries > 0) {
+      MemAddress = cache->tags[line_index] << (offsetBits + indexBits);
+      MemAddress = MemAddress | ((uint64_t)set_index << offsetBits);
+      putVictim(sim, cache, MemAddress, Block, isDirty(cache, line_index),
+                isShared(cache, line_index), mode);
+    } else if (isValid(cache, line_index) && (isDirty(cache, line_index) || exclusive)) {
+      stats->Writebacks += isDirty(cache, line_index); // line has dirty block
+      if (isDirty(cache, line_index))
+        TRACE_EVENT(1, EVENT_WRITEBACK, 1, CORE_NUMBER(sim), mode, set_index,
+                    cache->tags[line_index], sim->time);
+      MemAddress = cache->tags[line_index] << (offsetBits + indexBits);
+      MemAddress = MemAddress | ((uint64_t)set_index << offsetBits);
+      evictToL2(sim, MemAddress, Block, isDirty(cache, line_index)); // then write back old block
+    }
+    if (overlap)
+      recordMiss(sim, address >> offsetBits, endBackground(sim, &bg));
+    if (withData)
+      memcpy(Block, TempBlock, blockSize);
+    setValid(cache, line_index);
+    cache->tags[line_index] = Tag;
+    TRACE_EVENT(1, EVENT_FILL, 1, CORE_NUMBER(sim), mode, set_index, Tag, sim->time);
+    clearDirty(cache, line_index);
+    if (dirty)
+      setDirty(cache, line_index);
+    if (coherent)
+      setShared(cache, line_index, shared);
+  } // if miss, then replaced with the correct block
+
+  updatePolicy(cache, set_index, ways, set_line, hit);
+
+  // A prefetch is done once its block is in, at whatever time that is
+  if (mode == MODE_PREFETCH) {
+    cache->ready[line_index] = sim->time;
+    stats->Prefetches++;
+    return;
+  }
+
+  if (mode == MODE_READ) {    // read data from cache line
+    if (withData)
+      memcpy(data, &(Block[offset]), WORD_SIZE);
+    sim->time += sim->latency.L1Read;
+    stats->Reads++;
+    stats->Cycles += sim->latency.L1Read;
+  }
+
+  if (mode == MODE_WRITE) { // write data from cache line
+    // Only one L1 may write a block: a shared copy has to become the only one
+    if (coherent && isShared(cache, line_index)) {
+      sim->stats.coherence.Upgrades++;
+      busTransaction(sim, address - offset, 1);
+      setShared(cache, line_index, 0);
+    }
+    if (withData)
+      memcpy(&(Block[offset]), data, WORD_SIZE);
+    sim->time += sim->latency.L1Write;
+    stats->Writes++;
+    stats->Cycles += sim->latency.L1Write;
+    if (sim->write_policy.WriteThrough)
+      sendToL2(sim, address, withData ? data : NULL, WORD_SIZE);
+    else
+      setDirty(cache, line_index);
+  }
+
+  if (prefetcher != PREFETCH_NONE && (trigger || !hit))
+    issuePrefetches(sim, cache, stats, address >> offsetBits, !hit && !fromStream && !fromVictim);
+}
+
+void accessL1(Simulator *sim, uint64_t address, uint8_t *data, uint32_t mode) {
+
+  CacheGeometry *g = &sim->core->l1_cache.geometry;
+
+  /* init cache */
+  if (sim->core->l1_cache.init == 0)
+    setupCache(sim, &sim->core->l1_cache, L1_OFFSET_BITS, L1_INDEX_BITS, L1_WAYS);
+
+  /*
+  The default geometry gets its own copies of the access code, one with
+  and one without data movement, where everything is a constant.
+  */
+  if (sim->core->l1_cache.fixed && !sim->timing_only)
+    accessL1Line(sim, address, data, mode, L1_OFFSET_BITS, L1_INDEX_BITS, L1_WAYS, 1);
+  else if (sim->core->l1_cache.fixed)
+    accessL1Line(sim, address, data, mode, L1_OFFSET_BITS, L1_INDEX_BITS, L1_WAYS, 0);
+  else
+    accessL1Line(sim, address, data, mode, g->OffsetBits, g->IndexBits, g->Ways,
+                 !sim->timing_only);
+}
+
+/*********************** L2 cache *************************/
+
+void initL2Cache(Simulator *sim) { sim->l2_cache.init = 0; }
+
+/* Whether the mask covers every one of words words (NULL covers all of them). */
+static uint32_t wholeBlock(const uint64_t *mask, uint32_t words) {
+
+  for (uint32_t w = 0; mask != NULL && w < words; w++) {
+    if (((mask[w / 64] >> (w % 64)) & 1) == 0)
+      return 0;
+  }
+  return 1;
+}
+
+/* Copies the words of an L1 block whose bit is set in mask. */
+static void copyWords(uint8_t *to, const uint8_t *from, const uint64_t *mask, uint32_t words) {
+
+  for (uint32_t w = 0; w < words; w++) {
+    if ((mask[w / 64] >> (w % 64)) & 1)
+      memcpy(&to[w * WORD_SIZE], &from[w * WORD_SIZE], WORD_SIZE);
+  }
+}
+
+/*
+L2 is only accessed by L1, one L1 block at a time: a read hands back
+the L1 block containing address and a write stores one. A write with a
+mask only stores the words of the block whose bit is set (stores that
+went past L1 one word at a time); NULL means the whole block.
+
+MODE_FILL reads a block for an L1 fill and MODE_CLEAN writes a clean
+L1 victim, leaving the line clean. In an exclusive hierarchy a fill
+moves the block to L1 and we return whether it was dirty; otherwise
+they are a plain read and write, and we return 0.
+*/
+static ALWAYS_INLINE uint32_t accessL2Line(Simulator *sim, uint64_t address, uint8_t *data,
+                                       uint32_t mode, const uint64_t *mask,
+                                       uint32_t offsetBits, uint32_t indexBits,
+                                       uint32_t ways, uint32_t withData) {
+
+  uint32_t hit, set_line, set_index, line_index, offset;
+  uint64_t Tag, MemAddress;
+  uint32_t blockSize = 1 << offsetBits;
+  uint32_t transferSize = sim->core->l1_cache.geometry.BlockSize;
+  uint8_t TempBlock[MAX_BLOCK_SIZE];
+  LevelStats *stats = &sim->stats.l2;
+  Cache *cache = &sim->l2_cache;
+  uint32_t prefetcher = cache->prefetcher.config.Type, trigger = 0, fromStream = 0;
+  uint32_t exclusive = sim->inclusion == INCLUSION_EXCLUSIVE, move = exclusive && mode == MODE_FILL;
+  uint32_t clean = mode == MODE_CLEAN, dirty = 0;
+
+  if (mode == MODE_FILL)
+    mode = MODE_READ;
+  if (mode == MODE_CLEAN)
+    mode = MODE_WRITE;
+
+  Tag = address >> (offsetBits + indexBits);
+  offset = (uint32_t)address & (blockSize - 1);
+  set_index = (uint32_t)(address >> offsetBits) & ((1 << indexBits) - 1);
+
+  /*
+  We remove the offset bits so we get the exact place in memory
+  where our block is located.
+  */
+  MemAddress = address >> offsetBits;
+  MemAddress = MemAddress << offsetBits;
+
+  /*
+  If we get a hit on any of the lines of the set, we don't need to get
+  anything from the DRAM, we can just read or write immediately.
+  Otherwise lookupSet tells us in which line we can place our block.
+  */
+  set_line = lookupSet(&sim->l2_cache, set_index, ways, Tag, &hit);
+  line_index = set_index * ways + set_line;
+  uint8_t *Block = withData ? &sim->l2_cache.data[line_index * blockSize] : NULL;
+
+  if (hit && mode == MODE_PREFETCH)
+    return 0;
+  TRACE_EVENT(hit ? 2 : 1, hit ? EVENT_HIT : EVENT_MISS, 2, CORE_NUMBER(sim), mode, set_index,
+              Tag, sim->time);
+
+  // Prefetch bookkeeping works as in L1
+  if (hit && cache->prefetchedBits != NULL && isPrefetched(cache, line_index)) {
+    setPrefetched(cache, line_index, 0);
+    usePrefetch(sim, stats, cache->ready[line_index], 1);
+    trigger = 1;
+  }
+  if (!hit && prefetcher == PREFETCH_STREAM)
+    fromStream = trigger = takeStream(sim, cache, stats, MemAddress >> offsetBits,
+                                      withData ? TempBlock : NULL, 1);
+
+  if (!hit && move) {
+    // An exclusive L2 passes what it doesn't have straight from the DRAM to L1
+    stats->ReadMisses += !fromStream;
+    if (!fromStream)
+      accessDRAM(sim, MemAddress, withData ? TempBlock : NULL, MODE_READ);
+    Block = withData ? TempBlock : NULL;
+  } else if (!hit) {
+    stats->ReadMisses += mode == MODE_READ && !fromStream;
+    stats->WriteMisses += mode == MODE_WRITE && !fromStream;
+    stats->Evictions += isValid(&sim->l2_cache, line_index);
+    if (cache->prefetchedBits != NULL) {
+      stats->UnusedPrefetches += isValid(cache, line_index) && isPrefetched(cache, line_index);
+      setPrefetched(cache, line_index, mode == MODE_PREFETCH);
+    }
+
+    // Get block from the DRAM, unless an exclusive L2 is about to overwrite all of it
+    if (!fromStream &&
+        !(exclusive && mode == MODE_WRITE && wholeBlock(mask, transferSize / WORD_SIZE)))
+      accessDRAM(sim, MemAddress, withData ? TempBlock : NULL, MODE_READ);
+
+    MemAddress = sim->l2_cache.tags[line_index] << (offsetBits + indexBits);
+    MemAddress = MemAddress | ((uint64_t)set_index << offsetBits);
+    if (isValid(&sim->l2_cache, line_index))
+      TRACE_EVENT(1, EVENT_EVICTION, 2, CORE_NUMBER(sim), mode, set_index,
+                  sim->l2_cache.tags[line_index], sim->time);
+
+    // An inclusive L2 can't keep a block it evicts in L1 either
+    if (isValid(&sim->l2_cache, line_index) && sim->inclusion == INCLUSION_INCLUSIVE &&
+        backInvalidate(sim, MemAddress, Block))
+      setDirty(&sim->l2_cache, line_index);
+
+    // line has dirty block
+    if (isValid(&sim->l2_cache, line_index) && isDirty(&sim->l2_cache, line_index)) {
+      stats->Writebacks++;
+      TRACE_EVENT(1, EVENT_WRITEBACK, 2, CORE_NUMBER(sim), mode, set_index,
+                  sim->l2_cache.tags[line_index], sim->time);
+      accessDRAM(sim, MemAddress, Block, MODE_WRITE);
+    }
+
+    if (withData)
+      memcpy(Block, TempBlock, blockSize);
+    setValid(&sim->l2_cache, line_index);
+    sim->l2_cache.tags[line_index] = Tag;
+    TRACE_EVENT(1, EVENT_FILL, 2, CORE_NUMBER(sim), mode, set_index, Tag, sim->time);
+    clearDirty(&sim->l2_cache, line_index);
+  }
+
+  if (hit || !move)
+    updatePolicy(&sim->l2_cache, set_index, ways, set_line, hit);
+
+  if (mode == MODE_PREFETCH) {
+    cache->ready[line_index] = sim->time;
+    stats->Prefetches++;
+    return 0;
+  }
+
+  if (mode == MODE_READ) {
+    if (withData)
+      memcpy(data, &(Block[offset]), transferSize);
+    sim->time += sim->latency.L2Read;
+    stats->Reads++;
+    stats->Cycles += sim->latency.L2Read;
+
+    // The block moves to L1, dirty bit and all
+    if (move && hit) {
+      dirty = isDirty(&sim->l2_cache, line_index);
+      clearValid(&sim->l2_cache, line_index);
+      sim->stats.inclusion.Moves++;
+    }
+  }
+
+  if (mode == MODE_WRITE) {
+    if (withData && mask == NULL)
+      memcpy(&(Block[offset]), data, transferSize);
+    else if (withData)
+      copyWords(&(Block[offset]), data, mask, transferSize / WORD_SIZE);
+    if (!clean)
+      setDirty(&sim->l2_cache, line_index);
+    sim->time += sim->latency.L2Write;
+    stats->Writes++;
+    stats->Cycles += sim->latency.L2Write;
+  }
+
+  if (prefetcher != PREFETCH_NONE && (trigger || !hit))
+    issuePrefetches(sim, cache, stats, address >> offsetBits, !hit && !fromStream);
+  return dirty;
+}
+
+static uint32_t accessL2Masked(Simulator *sim, uint64_t address, uint8_t *data, uint32_t mode,
+                               const uint64_t *mask) {
+
+  CacheGeometry *g = &sim->l2_cache.geometry;
+
+  /* init cache */
+  if (sim->l2_cache.init == 0)
+    setupCache(sim, &sim->l2_cache, L2_2W_OFFSET_BITS, L2_2W_INDEX_BITS, L2_WAYS);
+
+  if (sim->l2_cache.fixed && !sim->timing_only)
+    return accessL2Line(sim, address, data, mode, mask, L2_2W_OFFSET_BITS, L2_2W_INDEX_BITS,
+                        L2_WAYS, 1);
+  else if (sim->l2_cache.fixed)
+    return accessL2Line(sim, address, data, mode, mask, L2_2W_OFFSET_BITS, L2_2W_INDEX_BITS,
+                        L2_WAYS, 0);
+  else
+    return accessL2Line(sim, address, data, mode, mask, g->OffsetBits, g->IndexBits, g->Ways,
+                        !sim->timing_only);
+}
+
+void accessL2(Simulator *sim, uint64_t address, uint8_t *data, uint32_t mode) {
+  accessL2Masked(sim, address, data, mode, NULL);
+}
+
+/*********************** Write buffer *************************/
+
+/* The entry of buffer b waiting for the L1 block at address, or NULL. */
+static WriteBufferEntry *findEntry(Simulator *sim, WriteBuffer *b, uint64_t address) {
+
+  for (uint32_t i = 0; i < b->count; i++) {
+    WriteBufferEntry *entry = &b->entries[(b->head + i) % sim->write_policy.BufferEntries];
+    if (entry->Address == address)
+      return entry;
+  }
+  return NULL;
+}
+
+/*
+Takes the oldest entry out of buffer b and writes it to L2. The drain
+starts when both the entry and L2 are ready and happens in the
+background, so we measure how long the write takes, keep L2 busy for
+that long and take it back off the simulated time.
+*/
+static void drainEntry(Simulator *sim, WriteBuffer *b) {
+
+  WriteBufferEntry *entry = &b->entries[b->head];
+  uint64_t start = b->portFree > entry->Queued ? b->portFree : entry->Queued, cost;
+  Background bg;
+
+  beginBackground(sim, &bg);
+  accessL2Masked(sim, entry->Address, entry->Data, MODE_WRITE, entry->Mask);
+  cost = endBackground(sim, &bg);
+
+  sim->stats.buffer.Drains++;
+  sim->stats.buffer.DrainCycles += cost;
+
+  b->portFree = start + cost;
+  b->head = (b->head + 1) % sim->write_policy.BufferEntries;
+  b->count--;
+}
+
+void flushWriteBuffer(Simulator *sim) {
+  for (uint32_t c = 0; c < sim->core_count; c++) {
+    while (sim->cores[c].write_buffer.count > 0)
+      drainEntry(sim, &sim->cores[c].write_buffer);
+  }
+}
+
+int setWritePolicy(Simulator *sim, const WritePolicy *policy) {
+
+  if (policy->BufferEntries > MAX_WRITE_BUFFER)
+    return -1;
+
+  flushWriteBuffer(sim);
+  sim->write_policy = *policy;
+
+  for (uint32_t c = 0; c < MAX_CORES; c++) {
+    WriteBuffer *b = &sim->cores[c].write_buffer;
+    free(b->entries);
+    *b = (WriteBuffer){.portFree = b->portFree};
+    if (policy->BufferEntries > 0)
+      b->entries = allocAligned(policy->BufferEntries * sizeof(WriteBufferEntry));
+  }
+  return 0;
+}
+
+static uint32_t fetchFromL2(Simulator *sim, uint64_t address, uint8_t *block, uint32_t fill) {
+
+  WriteBuffer *b = &sim->core->write_buffer;
+  WriteBufferEntry *entry;
+  uint32_t dirty;
+
+  dirty = accessL2Masked(sim, address, block, fill ? MODE_FILL : MODE_READ, NULL);
+
+  // Stores still waiting in the buffer are newer than what L2 has
+  if (block != NULL && b->count > 0 && (entry = findEntry(sim, b, address)) != NULL)
+    copyWords(block, entry->Data, entry->Mask, sim->core->l1_cache.geometry.BlockSize / WORD_SIZE);
+  return dirty;
+}
+
+static void sendToL2(Simulator *sim, uint64_t address, const uint8_t *data, uint32_t length) {
+
+  WriteBuffer *b = &sim->core->write_buffer;
+  uint32_t blockSize = sim->core->l1_cache.geometry.BlockSize;
+  uint32_t offset = (uint32_t)address & (blockSize - 1);
+  uint64_t blockAddress = address - offset, mask[BLOCK_MASK_WORDS] = {0}, stall;
+  uint8_t TempBlock[MAX_BLOCK_SIZE];
+  WriteBufferEntry *entry;
+
+  for (uint32_t w = offset / WORD_SIZE; w < (offset + length) / WORD_SIZE; w++)
+    mask[w / 64] |= 1ULL << (w % 64);
+
+  // Without a buffer L1 waits for the write to finish
+  if (sim->write_policy.BufferEntries == 0) {
+    if (length == blockSize) {
+      accessL2Masked(sim, blockAddress, (uint8_t *)data, MODE_WRITE, NULL);
+    } else {
+      if (data != NULL)
+        memcpy(&TempBlock[offset], data, length);
+      accessL2Masked(sim, blockAddress, data ? TempBlock : NULL, MODE_WRITE, mask);
+    }
+    return;
+  }
+
+  // Start every drain L2 could have started by now
+  while (b->count > 0 && b->portFree <= sim->time)
+    drainEntry(sim, b);
+
+  sim->stats.buffer.Stores++;
+  entry = findEntry(sim, b, blockAddress);
+
+  if (entry != NULL) {
+    sim->stats.buffer.Coalesced++;
+  } else {
+    if (b->count == sim->write_policy.BufferEntries) {
+      stall = b->portFree > sim->time ? b->portFree - sim->time : 0;
+      sim->time += stall;
+      sim->stats.buffer.StallCycles += stall;
+      drainEntry(sim, b);
+    }
+    entry = &b->entries[(b->head + b->count) % sim->write_policy.BufferEntries];
+    b->count++;
+    entry->Address = blockAddress;
+    entry->Queued = sim->time;
+    memset(entry->Mask, 0, sizeof(entry->Mask));
+  }
+
+  if (data != NULL)
+    memcpy(&entry->Data[offset], data, length);
+  for (uint32_t i = 0; i < BLOCK_MASK_WORDS; i++)
+    entry->Mask[i] |= mask[i];
+}
+
+static void evictToL2(Simulator *sim, uint64_t address, const uint8_t *data, uint32_t dirty) {
+
+  if (dirty) {
+    sendToL2(sim, address, data, sim->core->l1_cache.geometry.BlockSize);
+  } else if (sim->inclusion == INCLUSION_EXCLUSIVE) {
+    // L2 doesn't have the block, so even a clean one is worth keeping there
+    sim->stats.inclusion.CleanVictims++;
+    accessL2Masked(sim, address, (uint8_t *)data, MODE_CLEAN, NULL);
+  }
+}
+
+/*********************** Inclusion *************************/
+
+static const char *inclusionNames[INCLUSION_COUNT] = {"nine", "inclusive", "exclusive"};
+
+int parseInclusion(const char *name) {
+
+  for (int policy = 0; policy < INCLUSION_COUNT; policy++) {
+    if (strcmp(name, inclusionNames[policy]) == 0)
+      return policy;
+  }
+  return -1;
+}
+
+const char *inclusionName(uint32_t policy) {
+  return policy < INCLUSION_COUNT ? inclusionNames[policy] : "unknown";
+}
+
+int setInclusion(Simulator *sim, uint32_t policy) {
+
+  if (policy >= INCLUSION_COUNT)
+    return -1;
+  if (policy == INCLUSION_EXCLUSIVE &&
+      sim->cores[0].l1_cache.geometry.BlockSize != sim->l2_cache.geometry.BlockSize)
+    return -1;
+
+  // Whatever the caches hold may not fit the new policy
+  sim->inclusion = policy;
+  for (uint32_t c = 0; c < MAX_CORES; c++)
+    sim->cores[c].l1_cache.init = 0;
+  sim->l2_cache.init = 0;
+  return 0;
+}
+
+/*
+L2 of an inclusive hierarchy is evicting the block at address: every L1
+copy of it goes, victim caches included. Modified copies are merged
+into data, the L2 line, and we return whether there were any, in which
+case the line has to be written back. Stores to the block still in a
+write buffer would reach L2 after that and undo newer ones, so their
+entries are brought up to date with the modified copy too.
+*/
+static uint32_t backInvalidate(Simulator *sim, uint64_t address, uint8_t *data) {
+
+  uint32_t l2BlockSize = sim->l2_cache.geometry.BlockSize, dirty = 0, modified;
+  uint8_t *copy;
+  WriteBufferEntry *entry;
+
+  for (uint32_t c = 0; c < sim->core_count; c++) {
+    Cache *cache = &sim->cores[c].l1_cache;
+    VictimCache *v = &cache->victim;
+    WriteBuffer *b = &sim->cores[c].write_buffer;
+    uint32_t blockSize = cache->geometry.BlockSize;
+
+    if (!cache->init)
+      continue;
+
+    // An L2 block may hold several L1 blocks
+    for (uint32_t offset = 0; offset < l2BlockSize; offset += blockSize) {
+      int64_t line = findLine(cache, address + offset);
+      int32_t e = -1;
+
+      if (line < 0 && v->Entries > 0)
+        e = findVictim(v, (address + offset) >> cache->geometry.OffsetBits);
+      if (line < 0 && e < 0)
+        continue;
+
+      if (line >= 0) {
+        modified = isDirty(cache, (uint32_t)line);
+        copy = cache->data ? &cache->data[(size_t)line * blockSize] : NULL;
+        clearValid(cache, (uint32_t)line);
+        if (cache->prefetchedBits != NULL && isPrefetched(cache, (uint32_t)line)) {
+          sim->stats.l1.UnusedPrefetches++;
+          setPrefetched(cache, (uint32_t)line, 0);
+        }
+      } else {
+        modified = (v->dirty >> e) & 1;
+        copy = v->data ? &v->data[(size_t)e * blockSize] : NULL;
+        v->valid &= ~(1ULL << e);
+      }
+
+      sim->stats.inclusion.BackInvalidations++;
+      if (!modified)
+        continue;
+      sim->stats.inclusion.BackWritebacks++;
+      dirty = 1;
+      if (data != NULL && copy != NULL)
+        memcpy(&data[offset], copy, blockSize);
+      if (copy != NULL && b->count > 0 && (entry = findEntry(sim, b, address + offset)) != NULL)
+        copyWords(entry->Data, copy, entry->Mask, blockSize / WORD_SIZE);
+    }
+  }
+  return dirty;
+}
+
+/*
+How many bytes of distinct data the L1s (victim caches included) and L2
+hold together: all of L2, plus what the L1s have that L2 doesn't.
+Blocks several L1s share are counted once for each of them.
+*/
+static uint64_t distinctBytes(Simulator *sim) {
+
+  Cache *l2 = &sim->l2_cache;
+  uint64_t bytes = 0, address;
+
+  for (uint32_t line = 0; l2->init && line < l2->geometry.Lines; line++)
+    bytes += isValid(l2, line) ? l2->geometry.BlockSize : 0;
+
+  for (uint32_t c = 0; c < sim->core_count; c++) {
+    Cache *cache = &sim->cores[c].l1_cache;
+    CacheGeometry *g = &cache->geometry;
+
+    for (uint32_t line = 0; cache->init && line < g->Lines; line++) {
+      address = cache->tags[line] << (g->OffsetBits + g->IndexBits) |
+                (uint64_t)(line / g->Ways) << g->OffsetBits;
+      if (isValid(cache, line) && !(l2->init && containsBlock(l2, address)))
+        bytes += g->BlockSize;
+    }
+    for (uint32_t e = 0; cache->init && e < cache->victim.Entries; e++) {
+      address = cache->victim.blocks[e] << g->OffsetBits;
+      if (((cache->victim.valid >> e) & 1) && !(l2->init && containsBlock(l2, address)))
+        bytes += g->BlockSize;
+    }
+  }
+  return bytes;
+}
+
+/*********************** Coherence *************************/
+
+/* Snoops entry e of a victim cache, which holds the block at address, like an L1 line. */
+static uint32_t snoopVictim(Simulator *sim, Cache *cache, uint32_t e, uint64_t address,
+                            uint32_t exclusive) {
+
+  VictimCache *v = &cache->victim;
+
+  if ((v->dirty >> e) & 1) {
+    sim->stats.coherence.Interventions++;
+    accessL2Masked(sim, address,
+                   v->data ? &v->data[(size_t)e * cache->geometry.BlockSize] : NULL,
+                   MODE_WRITE, NULL);
+    v->dirty &= ~(1ULL << e);
+  }
+  if (!exclusive) {
+    v->shared |= 1ULL << e;
+    return 1;
+  }
+  v->valid &= ~(1ULL << e);
+  sim->stats.coherence.Invalidations++;
+  return 0;
+}
+
+/*
+What another core does when it sees a transaction for the L1 block at
+address. Stores it still has buffered go to L2 first, then its own
+copy (in L1 or the victim cache) if modified, so that the requester
+finds the newest data in L2.
+Then a read leaves its copy shared and anything else invalidates it,
+stream buffer blocks included. Returns whether it still holds the
+block.
+*/
+static uint32_t snoopCore(Simulator *sim, Core *other, uint64_t address, uint32_t exclusive) {
+
+  Cache *cache = &other->l1_cache;
+  WriteBuffer *b = &other->write_buffer;
+  Prefetcher *p = &cache->prefetcher;
+  uint64_t block = address >> cache->geometry.OffsetBits;
+  uint32_t s, i, streamed = 0;
+  int64_t line;
+  int32_t entry;
+
+  if (!cache->init) // not set up yet, so it holds nothing
+    return 0;
+
+  while (b->count > 0 && findEntry(sim, b, address) != NULL)
+    drainEntry(sim, b);
+
+  if ((line = findLine(cache, address)) >= 0 && isDirty(cache, (uint32_t)line)) {
+    sim->stats.coherence.Interventions++;
+    accessL2Masked(sim, address,
+                   cache->data ? &cache->data[(size_t)line * cache->geometry.BlockSize] : NULL,
+                   MODE_WRITE, NULL);
+    clearDirty(cache, (uint32_t)line);
+  }
+
+  if (p->config.Type == PREFETCH_STREAM && findStream(p, block, &s, &i)) {
+    if (exclusive) {
+      removeStream(p, &sim->stats.l1, s, i);
+      sim->stats.l1.UnusedPrefetches++;
+    } else {
+      streamed = 1;
+    }
+  }
+
+  // Not in L1, but maybe in its victim cache
+  if (line < 0 && cache->victim.Entries > 0 && (entry = findVictim(&cache->victim, block)) >= 0)
+    return snoopVictim(sim, cache, (uint32_t)entry, address, exclusive) | streamed;
+  if (line < 0)
+    return streamed;
+  if (!exclusive) {
+    setShared(cache, (uint32_t)line, 1);
+    return 1;
+  }
+  clearValid(cache, (uint32_t)line);
+  sim->stats.coherence.Invalidations++;
+  return 0;
+}
+
+static uint32_t busTransaction(Simulator *sim, uint64_t address, uint32_t exclusive) {
+
+  uint64_t wait = sim->busFree > sim->time ? sim->busFree - sim->time : 0;
+  uint32_t shared = 0;
+
+  // One transaction at a time: wait for the bus, then snoop everybody
+  sim->time += wait + sim->latency.Snoop;
+  sim->stats.coherence.ContentionCycles += wait;
+  sim->stats.coherence.BusCycles += sim->latency.Snoop;
+  sim->busFree = sim->time;
+
+  for (uint32_t c = 0; c < sim->core_count; c++) {
+    if (&sim->cores[c] != sim->core)
+      shared |= snoopCore(sim, &sim->cores[c], address, exclusive);
+  }
+  return shared;
+}
+
+/*********************** Prefetching *************************/
+
+static int checkPrefetch(const PrefetchConfig *config) {
+
+  if (config->Type >= PREFETCH_COUNT)
+    return -1;
+  if (config->Type != PREFETCH_NONE &&
+      (config->Degree == 0 || config->Degree > MAX_PREFETCH_DEGREE))
+    return -1;
+  if ((config->Type == PREFETCH_STRIDE || config->Type == PREFETCH_STREAM) &&
+      (config->Entries == 0 || config->Entries > MAX_PREFETCH_ENTRIES))
+    return -1;
+  return 0;
+}
+
+int setPrefetcher(Simulator *sim, uint32_t level, const PrefetchConfig *config) {
+
+  if (level != 1 && level != 2)
+    return -1;
+  if (checkPrefetch(config) < 0)
+    return -1;
+
+  // Every core gets the same L1 prefetcher
+  for (uint32_t c = 0; c < (level == 1 ? MAX_CORES : 1); c++) {
+    Cache *cache = level == 1 ? &sim->cores[c].l1_cache : &sim->l2_cache;
+    freePrefetcher(cache);
+    cache->prefetcher.config = *config;
+    cache->init = 0;
+  }
+  return 0;
+}
+
+static const char *prefetcherNames[PREFETCH_COUNT] = {"none", "next", "stride", "stream"};
+
+int parsePrefetcher(const char *name) {
+
+  for (int type = 0; type < PREFETCH_COUNT; type++) {
+    if (strcmp(name, prefetcherNames[type]) == 0)
+      return type;
+  }
+  return -1;
+}
+
+/*
+The address of a block to prefetch, or 0 with *ok cleared if it is
+past the end of the address space or of the simulated memory.
+*/
+static uint64_t prefetchAddress(Simulator *sim, uint64_t block, uint32_t offsetBits,
+                                uint32_t *ok) {
+
+  uint64_t address = block << offsetBits;
+
+  *ok = address >> offsetBits == block && inMemory(sim, address);
+  return *ok ? address : 0;
+}
+
+/*
+With MSHRs, an L1 prefetch needs a free one just like a miss, but
+rather than waiting for one it is dropped.
+*/
+static uint32_t claimPrefetch(Simulator *sim, Cache *cache) {
+
+  if (cache != &sim->core->l1_cache || sim->mshrs == 0)
+    return 1;
+
+  retireMisses(sim);
+  if (sim->core->mshr_file.count < sim->mshrs)
+    return 1;
+  sim->stats.mshr.Dropped++;
+  return 0;
+}
+
+/* Takes the MSHR claimed for a prefetch of block that took latency cycles. */
+static void recordPrefetch(Simulator *sim, Cache *cache, uint64_t block, uint64_t latency) {
+  if (cache == &sim->core->l1_cache && sim->mshrs > 0)
+    recordMiss(sim, block, latency);
+}
+
+/* Appends block to stream buffer s, fetching it in the background. */
+static void fetchStream(Simulator *sim, Cache *cache, LevelStats *stats, uint32_t s,
+                        uint64_t block, uint64_t address) {
+
+  Prefetcher *p = &cache->prefetcher;
+  StreamBuffer *stream = &p->streams[s];
+  uint32_t slot = s * p->config.Degree + (stream->head + stream->count) % p->config.Degree;
+  uint8_t *data = p->data ? &p->data[(size_t)slot * cache->geometry.BlockSize] : NULL;
+  Background bg;
+  uint64_t latency;
+
+  beginBackground(sim, &bg);
+  if (cache == &sim->core->l1_cache && sim->core_count > 1) {
+    sim->stats.coherence.Reads++;
+    busTransaction(sim, address, 0);
+  }
+  if (cache == &sim->core->l1_cache)
+    fetchFromL2(sim, address, data, 0);
+  else
+    accessDRAM(sim, address, data, MODE_READ);
+  p->ready[slot] = sim->time;
+  latency = endBackground(sim, &bg);
+  stats->PrefetchCycles += latency;
+  recordPrefetch(sim, cache, block, latency);
+
+  p->blocks[slot] = block;
+  stream->count++;
+  stats->Prefetches++;
+}
+
+/*
+Every prefetch starts now and runs in the background. Only L1's MSHRs,
+if it has any, limit how many are on their way at once.
+*/
+static void issuePrefetches(Simulator *sim, Cache *cache, LevelStats *stats, uint64_t block,
+                            uint32_t missed) {
+
+  Prefetcher *p = &cache->prefetcher;
+  uint32_t offsetBits = cache->geometry.OffsetBits, count, ok;
+  uint64_t targets[MAX_PREFETCH_DEGREE], address, latency;
+  Background bg;
+
+  if (p->config.Type == PREFETCH_STREAM) {
+    // A miss nobody saw coming restarts the least recently used buffer
+    if (missed) {
+      p->last = 0;
+      for (uint32_t s = 1; s < p->config.Entries; s++) {
+        if (p->streams[s].LastUse < p->streams[p->last].LastUse)
+          p->last = s;
+      }
+      stats->UnusedPrefetches += p->streams[p->last].count;
+      p->streams[p->last] = (StreamBuffer){.Next = block + 1, .LastUse = ++p->clock};
+    }
+
+    // Top up the buffer in use, skipping blocks we already have
+    StreamBuffer *stream = &p->streams[p->last];
+    while (stream->count < p->config.Degree) {
+      address = prefetchAddress(sim, stream->Next, offsetBits, &ok);
+      if (!ok)
+        break;
+      if (!containsBlock(cache, address) && !inStreams(p, stream->Next)) {
+        if (!claimPrefetch(sim, cache))
+          break;
+        fetchStream(sim, cache, stats, p->last, stream->Next, address);
+      }
+      stream->Next++;
+    }
+    return;
+  }
+
+  count = prefetchTargets(p, block, offsetBits, targets);
+  for (uint32_t i = 0; i < count; i++) {
+    address = prefetchAddress(sim, targets[i], offsetBits, &ok);
+    if (!ok || containsBlock(cache, address))
+      continue;
+    if (!claimPrefetch(sim, cache))
+      break;
+
+    beginBackground(sim, &bg);
+    if (cache == &sim->core->l1_cache)
+      accessL1(sim, address, NULL, MODE_PREFETCH);
+    else
+      accessL2Masked(sim, address, NULL, MODE_PREFETCH, NULL);
+    latency = endBackground(sim, &bg);
+    stats->PrefetchCycles += latency;
+    recordPrefetch(sim, cache, targets[i], latency);
+  }
+}
+
+/* Hands an access to the running capture, if any (see Capture.h). */
+static ALWAYS_INLINE void capture(uint64_t address, uint32_t mode) {
+
+  uint32_t session = atomic_load_explicit(&captureActive, memory_order_relaxed);
+
+  if (__builtin_expect(session != 0, 0))
+    captureAccess(session, address, mode);
+}
+
+int read(Simulator *sim, uint64_t address, uint8_t *data) {
+
+  capture(address, MODE_READ);
+  if (!inMemory(sim, address))
+    return -1;
+  accessL1(sim, address, data, MODE_READ);
+  return 0;
+}
+
+int write(Simulator *sim, uint64_t address, uint8_t *data) {
+
+  capture(address, MODE_WRITE);
+  if (!inMemory(sim, address))
+    return -1;
+  accessL1(sim, address, data, MODE_WRITE);
+  return 0;
+}
+
+/*********************** Batch interfaces *************************/
+
+/*
+How many accesses ahead we prefetch set metadata. By the time we get
+there the set's tags and valid bits should be in the host cache.
+*/
+#define PREFETCH_DISTANCE 8
+
+/*
+Sequential code touches the same block many times in a row. Once the
+first of those accesses is done, the block is normally in L1 and the
+rest of them are plain hits, which is all this handles: from start on,
+it takes the accesses to the same block with a single lookup, adds up
+their time and counts, and touches the replacement state once, exactly
+as accessL1Line would have one access at a time. Anything a hit can't
+be sure to do the same way (a write-through store, a store to a shared
+line, an access outside the memory) ends the run and is left to
+accessL1Line. Returns how many accesses were taken, maybe none.
+*/
+static ALWAYS_INLINE uint32_t accessL1Run(Simulator *sim, const uint64_t *addresses,
+                                          const uint8_t *modes, uint32_t mode, uint8_t *data,
+                                          uint32_t start, uint32_t count, uint32_t offsetBits,
+                                          uint32_t indexBits, uint32_t ways, uint32_t withData) {
+
+  Cache *cache = &sim->core->l1_cache;
+  MSHRFile *f = &sim->core->mshr_file;
+  Replacement *r = &cache->replacement;
+  uint64_t block = addresses[start] >> offsetBits, time = sim->time, completes = 0;
+  uint32_t set_index = (uint32_t)block & ((1 << indexBits) - 1);
+  uint32_t blockSize = 1 << offsetBits, first = set_index * ways, set_line, line_index, i;
+  uint32_t reads = 0, writes = 0, merges = 0, stores;
+  uint64_t match;
+  uint8_t *Block;
+
+  // Not lookupSet: on a miss that picks a victim, which may change the policy state
+  match = matchTags(&cache->tags[first], ways, block >> indexBits) &
+          (cache->validBits[first / 64] >> (first % 64)) & lowMask(ways);
+  if (match == 0)
+    return 0;
+  set_line = __builtin_ctzll(match);
+  line_index = first + set_line;
+  if (cache->prefetchedBits != NULL && isPrefetched(cache, line_index))
+    return 0;
+  Block = withData ? &cache->data[line_index * blockSize] : NULL;
+  stores = !sim->write_policy.WriteThrough &&
+           !(sim->core_count > 1 && isShared(cache, line_index));
+
+  // A hit is merged into a miss to its block still outstanding at the time
+  for (uint32_t m = 0; m < f->count; m++) {
+    if (f->entries[m].Block == block && f->entries[m].Completes > completes)
+      completes = f->entries[m].Completes;
+  }
+
+  for (i = start; i < count && addresses[i] >> offsetBits == block; i++) {
+    uint32_t accessMode = modes ? modes[i] : mode;
+    uint32_t offset = (uint32_t)addresses[i] & (blockSize - 1);
+
+    if (!inMemory(sim, addresses[i]) || (accessMode == MODE_WRITE && !stores) ||
+        (accessMode != MODE_READ && accessMode != MODE_WRITE))
+      break;
+
+    merges += time < completes;
+    TRACE_EVENT(2, EVENT_HIT, 1, CORE_NUMBER(sim), accessMode, set_index, block >> indexBits,
+                time);
+    if (accessMode == MODE_READ) {
+      if (withData && data != NULL)
+        memcpy(&data[i * WORD_SIZE], &Block[offset], WORD_SIZE);
+      time += sim->latency.L1Read;
+      reads++;
+    } else {
+      if (withData && data != NULL)
+        memcpy(&Block[offset], &data[i * WORD_SIZE], WORD_SIZE);
+      else if (withData)
+        memset(&Block[offset], 0, WORD_SIZE);
+      time += sim->latency.L1Write;
+      writes++;
+    }
+  }
+
+  if (i == start)
+    return 0;
+  touchLineRepeatedly(r, &r->state[set_index * r->Words], ways, set_line, i - start);
+  if (writes > 0)
+    setDirty(cache, line_index);
+  sim->stats.l1.Reads += reads;
+  sim->stats.l1.Writes += writes;
+  sim->stats.l1.Cycles += time - sim->time;
+  sim->stats.mshr.Merges += merges;
+  sim->time = time;
+  return i - start;
+}
+
+static ALWAYS_INLINE uint32_t accessL1Batch(Simulator *sim, const uint64_t *addresses,
+                                            const uint8_t *modes, uint32_t mode, uint8_t *data,
+                                            uint32_t count,
+                                            uint32_t offsetBits, uint32_t indexBits,
+                                            uint32_t ways, uint32_t withData) {
+
+  uint32_t set_index, scratch, rejected = 0;
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (i + PREFETCH_DISTANCE < count) {
+      set_index = (uint32_t)(addresses[i + PREFETCH_DISTANCE] >> offsetBits) &
+                  ((1 << indexBits) - 1);
+      __builtin_prefetch(&sim->core->l1_cache.tags[set_index * ways]);
+      __builtin_prefetch(&sim->core->l1_cache.validBits[set_index * ways / 64]);
+    }
+
+    if (!inMemory(sim, addresses[i])) {
+      rejected++;
+      continue;
+    }
+
+    scratch = 0; // without a data array reads are dropped and writes store 0
+    accessL1Line(sim, addresses[i], data ? &data[i * WORD_SIZE] : (uint8_t *)&scratch,
+                 modes ? modes[i] : mode, offsetBits, indexBits, ways, withData);
+
+    if (i + 1 < count && addresses[i + 1] >> offsetBits == addresses[i] >> offsetBits)
+      i += accessL1Run(sim, addresses, modes, mode, data, i + 1, count, offsetBits, indexBits,
+                       ways, withData);
+  }
+  return rejected;
+}
+
+/*
+Runs count accesses in one call. The init check and the choice of
+specialized code happen once for the whole batch instead of once per
+access. modes holds MODE_READ/MODE_WRITE per access, or is NULL to use
+mode for all of them. data holds one word per access (read into or
+written from) and may be NULL.
+*/
+static uint32_t runBatch(Simulator *sim, const uint64_t *addresses, const uint8_t *modes,
+                         uint32_t mode, uint8_t *data, uint32_t count) {
+
+  CacheGeometry *g = &sim->core->l1_cache.geometry;
+
+  if (sim->core->l1_cache.init == 0)
+    setupCache(sim, &sim->core->l1_cache, L1_OFFSET_BITS, L1_INDEX_BITS, L1_WAYS);
+
+  if (atomic_load_explicit(&captureActive, memory_order_relaxed) != 0) {
+    for (uint32_t i = 0; i < count; i++)
+      capture(addresses[i], modes ? modes[i] : mode);
+  }
+
+  if (sim->core->l1_cache.fixed && !sim->timing_only)
+    return accessL1Batch(sim, addresses, modes, mode, data, count,
+                         L1_OFFSET_BITS, L1_INDEX_BITS, L1_WAYS, 1);
+  else if (sim->core->l1_cache.fixed)
+    return accessL1Batch(sim, addresses, modes, mode, data, count,
+                         L1_OFFSET_BITS, L1_INDEX_BITS, L1_WAYS, 0);
+  else
+    return accessL1Batch(sim, addresses, modes, mode, data, count,
+                         g->OffsetBits, g->IndexBits, g->Ways, !sim->timing_only);
+}
+
+uint32_t accessBatch(Simulator *sim, const uint64_t *addresses, const uint8_t *modes,
+                     uint8_t *data, uint32_t count) {
+  return runBatch(sim, addresses, modes, MODE_READ, data, count);
+}
+
+uint32_t readBatch(Simulator *sim, const uint64_t *addresses, uint8_t *data, uint32_t count) {
+  return runBatch(sim, addresses, NULL, MODE_READ, data, count);
+}
+
+uint32_t writeBatch(Simulator *sim, const uint64_t *addresses, uint8_t *data, uint32_t count) {
+  return runBatch(sim, addresses, NULL, MODE_WRITE, data, count);
+}
+
+/*********************** Functional warming *************************/
+
+/*
+Warming keeps the tags, valid and dirty bits and replacement state of
+L1 and L2 where demand accesses would leave them, and does nothing
+else: no time passes, nothing is counted, and the prefetchers, MSHRs,
+write buffer and bus are left alone. The write policy and the inclusion
+policy are followed. A block L1 evicts goes to L2 as if there were no
+victim cache, and one L1 finds in its victim cache is taken out of it,
+so that no block ends up in both.
+*/
+
+/* Drops the L1 copies of an L2 block that an inclusive L2 is evicting. */
+static void warmBackInvalidate(Simulator *sim, uint64_t address) {
+
+  uint32_t l2Block = sim->l2_cache.geometry.BlockSize;
+
+  for (uint32_t c = 0; c < sim->core_count; c++) {
+    Cache *l1 = &sim->cores[c].l1_cache;
+    uint32_t l1Block = l1->geometry.BlockSize;
+
+    if (l1->init == 0)
+      continue;
+    for (uint64_t a = address; a < address + l2Block; a += l1Block) {
+      int64_t line = findLine(l1, a);
+      int32_t entry;
+
+      if (line >= 0)
+        clearValid(l1, (uint32_t)line);
+      if (l1->victim.Entries > 0 &&
+          (entry = findVictim(&l1->victim, a >> l1->geometry.OffsetBits)) >= 0)
+        l1->victim.valid &= ~(1ULL << entry);
+    }
+  }
+}
+
+/*
+Warms L2 with the L1 block at address: MODE_FILL for an L1 fill, in
+which case we return whether an exclusive L2 handed over a dirty block,
+or MODE_WRITE for a block (dirty or not) written back.
+*/
+static uint32_t warmL2(Simulator *sim, uint64_t address, uint32_t mode, uint32_t dirty) {
+
+  Cache *cache = &sim->l2_cache;
+  CacheGeometry *g = &cache->geometry;
+  uint32_t hit, set_line, line_index;
+  uint32_t set_index = (uint32_t)(address >> g->OffsetBits) & (g->Sets - 1);
+  uint64_t Tag = address >> (g->OffsetBits + g->IndexBits), MemAddress;
+
+  set_line = lookupSet(cache, set_index, g->Ways, Tag, &hit);
+  line_index = set_index * g->Ways + set_line;
+
+  // An exclusive L2 passes its block on to L1, or has nothing to do
+  if (mode == MODE_FILL && sim->inclusion == INCLUSION_EXCLUSIVE) {
+    if (!hit)
+      return 0;
+    updatePolicy(cache, set_index, g->Ways, set_line, hit);
+    dirty = isDirty(cache, line_index);
+    clearValid(cache, line_index);
+    return dirty;
+  }
+
+  if (!hit) {
+    if (isValid(cache, line_index) && sim->inclusion == INCLUSION_INCLUSIVE) {
+      MemAddress = cache->tags[line_index] << (g->OffsetBits + g->IndexBits);
+      warmBackInvalidate(sim, MemAddress | ((uint64_t)set_index << g->OffsetBits));
+    }
+    setValid(cache, line_index);
+    cache->tags[line_index] = Tag;
+    clearDirty(cache, line_index);
+  }
+  updatePolicy(cache, set_index, g->Ways, set_line, hit);
+
+  if (mode == MODE_WRITE && dirty)
+    setDirty(cache, line_index);
+  return 0;
+}
+
+static void warmL1(Simulator *sim, uint64_t address, uint32_t mode) {
+
+  Cache *cache = &sim->core->l1_cache;
+  CacheGeometry *g = &cache->geometry;
+  uint32_t hit, set_line, line_index, dirty = 0;
+  uint32_t set_index = (uint32_t)(address >> g->OffsetBits) & (g->Sets - 1);
+  uint64_t Tag = address >> (g->OffsetBits + g->IndexBits), MemAddress;
+  int32_t entry = -1;
+
+  set_line = lookupSet(cache, set_index, g->Ways, Tag, &hit);
+  line_index = set_index * g->Ways + set_line;
+  MemAddress = address & ~(uint64_t)(g->BlockSize - 1);
+
+  if (!hit && mode == MODE_WRITE && sim->write_policy.NoWriteAllocate) {
+    warmL2(sim, MemAddress, MODE_WRITE, 1);
+    return;
+  }
+
+  if (!hit) {
+    if (cache->victim.Entries > 0)
+      entry = findVictim(&cache->victim, MemAddress >> g->OffsetBits);
+    if (entry >= 0) {
+      dirty = (cache->victim.dirty >> entry) & 1;
+      cache->victim.valid &= ~(1ULL << entry);
+    } else {
+      dirty = warmL2(sim, MemAddress, MODE_FILL, 0);
+    }
+
+    if (isValid(cache, line_index) &&
+        (isDirty(cache, line_index) || sim->inclusion == INCLUSION_EXCLUSIVE)) {
+      MemAddress = cache->tags[line_index] << (g->OffsetBits + g->IndexBits);
+      warmL2(sim, MemAddress | ((uint64_t)set_index << g->OffsetBits), MODE_WRITE,
+             isDirty(cache, line_index));
+    }
+    setValid(cache, line_index);
+    cache->tags[line_index] = Tag;
+    clearDirty(cache, line_index);
+    setShared(cache, line_index, 0);
+    if (dirty)
+      setDirty(cache, line_index);
+  }
+  updatePolicy(cache, set_index, g->Ways, set_line, hit);
+
+  if (mode == MODE_WRITE && sim->write_policy.WriteThrough)
+    warmL2(sim, address & ~(uint64_t)(g->BlockSize - 1), MODE_WRITE, 1);
+  else if (mode == MODE_WRITE)
+    setDirty(cache, line_index);
+}
+
+uint32_t warmBatch(Simulator *sim, const uint64_t *addresses, const uint8_t *modes,
+                   uint32_t count) {
+
+  uint32_t rejected = 0;
+
+  if (sim->core->l1_cache.init == 0)
+    setupCache(sim, &sim->core->l1_cache, L1_OFFSET_BITS, L1_INDEX_BITS, L1_WAYS);
+  if (sim->l2_cache.init == 0)
+    setupCache(sim, &sim->l2_cache, L2_2W_OFFSET_BITS, L2_2W_INDEX_BITS, L2_WAYS);
+
+  for (uint32_t i = 0; i < count; i++) {
+    if (!inMemory(sim, addresses[i]))
+      rejected++;
+    else
+      warmL1(sim, addresses[i], modes[i]);
+  }
+  return rejected;
+}
+
+/*********************** Checking *************************/
+
+/*
+One level of a simulator under checkSimulator: its settings as the set
+functions leave them and, once set up, derived geometry and arrays of
+the size and contents its accesses assume. The derived fields of a
+level not set up yet are filled in when it is.
+*/
+static int checkCache(const Simulator *sim, const Cache *cache, uint32_t offsetBits,
+                      uint32_t indexBits, uint32_t ways) {
+
+  CacheGeometry g = cache->geometry;
+  const Replacement *r = &cache->replacement;
+  const Prefetcher *p = &cache->prefetcher;
+  const VictimCache *v = &cache->victim;
+
+  if (deriveGeometry(&g) < 0)
+    return -1;
+  if (checkPrefetch(&p->config) < 0 || v->Entries > MAX_VICTIMS ||
+      ((v->valid | v->dirty | v->shared) & ~wayMask(v->Entries)) != 0)
+    return -1;
+  if (cache->init == 0)
+    return 0;
+
+  if (cache->init != 1 || memcmp(&g, &cache->geometry, sizeof(g)) != 0 ||
+      r->Policy != g.Policy || r->Words != replacementWords(g.Policy, g.Ways) ||
+      cache->fixed != (g.OffsetBits == offsetBits && g.IndexBits == indexBits && g.Ways == ways))
+    return -1;
+  for (uint32_t set = 0; set < g.Sets; set++) {
+    if (!validSet(r, &r->state[(size_t)set * r->Words], g.Ways))
+      return -1;
+  }
+
+  if (!sim->timing_only && (cache->data == NULL || (v->Entries > 0 && v->data == NULL) ||
+                            (p->config.Type == PREFETCH_STREAM && p->data == NULL)))
+    return -1;
+  if (p->config.Type == PREFETCH_STREAM) {
+    if (p->last >= p->config.Entries)
+      return -1;
+    for (uint32_t e = 0; e < p->config.Entries; e++) {
+      if (p->streams[e].head >= p->config.Degree || p->streams[e].count > p->config.Degree)
+        return -1;
+    }
+  }
+  return 0;
+}
+
+int checkSimulator(const Simulator *sim) {
+
+  const Cache *l1 = &sim->cores[0].l1_cache, *l2 = &sim->l2_cache;
+  uint32_t entries = sim->write_policy.BufferEntries;
+
+  if (sim->core_count == 0 || sim->core_count > MAX_CORES || sim->inclusion >= INCLUSION_COUNT ||
+      sim->mshrs > MAX_MSHRS || entries > MAX_WRITE_BUFFER || sim->timing_only > 1)
+    return -1;
+  if (l1->geometry.BlockSize > l2->geometry.BlockSize ||
+      (sim->inclusion == INCLUSION_EXCLUSIVE && l1->geometry.BlockSize != l2->geometry.BlockSize))
+    return -1;
+
+  // Every core has the same L1, as the set functions give them
+  for (uint32_t c = 0; c < MAX_CORES; c++) {
+    const Core *core = &sim->cores[c];
+    const Cache *cache = &core->l1_cache;
+
+    if (cache->geometry.Size != l1->geometry.Size ||
+        cache->geometry.BlockSize != l1->geometry.BlockSize ||
+        cache->geometry.Ways != l1->geometry.Ways ||
+        cache->geometry.Policy != l1->geometry.Policy ||
+        memcmp(&cache->prefetcher.config, &l1->prefetcher.config, sizeof(PrefetchConfig)) != 0 ||
+        cache->victim.Entries != l1->victim.Entries)
+      return -1;
+    if (checkCache(sim, cache, L1_OFFSET_BITS, L1_INDEX_BITS, L1_WAYS) < 0)
+      return -1;
+    if (core->write_buffer.count > entries || (entries > 0 && core->write_buffer.head >= entries) ||
+        core->mshr_file.count > sim->mshrs)
+      return -1;
+  }
+
+  if (l2->victim.Entries != 0 ||
+      checkCache(sim, l2, L2_2W_OFFSET_BITS, L2_2W_INDEX_BITS, L2_WAYS) < 0)
+    return -1;
+  return 0;
+}
@@ -6,42 +6,508 @@
 #include <string.h>
 #include <stdint.h>
 #include "Cache.h"
+#include "Memory.h"
+#include "Replacement.h"
+#include "Prefetch.h"
 
-void resetTime();
+#define MAX_BLOCK_SIZE 1024 // in bytes, largest block size we accept
 
-uint32_t getTime();
+/*********************** Cache *************************/
 
-/****************  RAM memory (byte addressable) ***************/
-void accessDRAM(uint32_t, uint8_t *, uint32_t);
+/*
+Shape of one cache level. Size, BlockSize and Ways are chosen by the
+user (all powers of two, at most MAX_WAYS ways); Sets, Lines and the
+bit counts are derived from them when the level is set up. Policy is
+one of the POLICY_ constants in Replacement.h, LRU if left at 0.
+*/
+typedef struct CacheGeometry {
+  uint32_t Size;      // in bytes
+  uint32_t BlockSize; // in bytes
+  uint32_t Ways;      // lines per set
+  uint32_t Sets;
+  uint32_t Lines;
+  uint32_t OffsetBits;
+  uint32_t IndexBits;
+  uint32_t Policy;
+} CacheGeometry;
 
-/*********************** Cache *************************/
+/*
+A small fully associative cache beside L1 catching the lines L1 evicts
+(a victim cache). An L1 miss looks here before going to L2: if the
+block is found, it swaps places with the L1 line being replaced and
+the access takes Latencies.Victim cycles instead of an L2 access.
+Otherwise the evicted L1 line comes in, pushing out the oldest entry,
+which is written back to L2 if dirty. Lines keep their dirty and
+shared bits while they are here, so as far as writebacks and
+coherence go the victim cache is part of L1. A block is never in both.
+*/
+#define MAX_VICTIMS 64 // entries, one bit each in a word
 
-void initL1Cache();
-void initL2Cache();
-void accessL1(uint32_t, uint8_t *, uint32_t);
-void accessL2(uint32_t, uint8_t *, uint32_t);
+typedef struct VictimCache {
+  uint32_t Entries;              // 0 for none
+  uint64_t blocks[MAX_VICTIMS];  // block number held by each entry
+  uint64_t stamps[MAX_VICTIMS];  // when each entry was filled, oldest is evicted first
+  uint64_t valid, dirty, shared; // one bit per entry
+  uint8_t *data;                 // BlockSize per entry, NULL if timing-only
+  uint64_t clock;
+} VictimCache;
 
-typedef struct CacheLine {
-  uint8_t Valid;
-  uint8_t Dirty;
-  uint32_t Tag;
-  uint32_t Time; // Timestamp used for LRU policy
-} CacheLine;
+/*
+Line metadata is kept as a structure of arrays: all tags of a set sit
+next to each other so they can be compared at once (see TagMatch.h),
+and valid/dirty are single bits. Line i of the cache is line i % Ways
+of set i / Ways; its valid bit is bit i % 64 of validBits[i / 64], and
+likewise for dirtyBits. Every array is 64-byte aligned.
 
-typedef struct CacheL1 {
+With several cores the L1 lines also carry a MESI state: invalid is
+not valid, modified is dirty, shared has its bit set in sharedBits and
+exclusive is none of those.
+*/
+typedef struct Cache {
   uint32_t init;
-  CacheLine lines[L1_SIZE / BLOCK_SIZE];
-} CacheL1;
+  uint32_t fixed; // geometry matches Cache.h, use the specialized path
+  CacheGeometry geometry;
+  uint64_t *tags;
+  Replacement replacement; // policy state of every set
+  uint64_t *validBits;
+  uint64_t *dirtyBits;
+  uint64_t *sharedBits;
+  uint8_t *data; // Size bytes, line i holds data[i * BlockSize...], NULL if timing-only
+  Prefetcher prefetcher;
+  uint64_t *prefetchedBits; // lines prefetched and not used yet, NEXT_LINE and STRIDE only
+  uint64_t *ready;          // per line, time its prefetch arrives
+  VictimCache victim;       // L1 only
+} Cache;
 
-typedef struct CacheL2 {
-  uint32_t init;
-  CacheLine lines[L2_SIZE / BLOCK_SIZE];
-} CacheL2;
+/*********************** Simulator *************************/
+
+/*
+Time taken by each kind of access, defaulting to the values in Cache.h.
+They're read on every access, so they can be changed at any time.
+*/
+typedef struct Latencies {
+  uint32_t L1Read;
+  uint32_t L1Write;
+  uint32_t L2Read;
+  uint32_t L2Write;
+  uint32_t DRAMRead;
+  uint32_t DRAMWrite;
+  uint32_t Snoop;  // one bus transaction, only with several cores
+  uint32_t Victim; // an L1 miss found in the victim cache
+} Latencies;
+
+#define SNOOP_TIME 4
+#define VICTIM_TIME 2
+
+/*
+Event counters of one cache level. Hits are not counted separately:
+they're the accesses minus the misses, which keeps the hit path down to
+an access count and a cycle count. Evictions are valid lines replaced
+on a miss, and Writebacks the dirty ones among them, which were written
+to the next level.
+*/
+typedef struct LevelStats {
+  uint64_t Reads;
+  uint64_t Writes;
+  uint64_t ReadMisses;
+  uint64_t WriteMisses;
+  uint64_t Evictions;
+  uint64_t Writebacks;
+  uint64_t Cycles; // latency charged to this level
+  uint64_t Prefetches;       // blocks the prefetcher brought in
+  uint64_t UsefulPrefetches; // of which a demand access used
+  uint64_t LatePrefetches;   // of which the demand access had to wait for
+  uint64_t UnusedPrefetches; // evicted or dropped before being used
+  uint64_t PrefetchStalls;   // cycles spent waiting for late prefetches
+  uint64_t PrefetchCycles;   // next-level time of the prefetches, hidden behind execution
+} LevelStats;
+
+typedef struct DRAMStats {
+  uint64_t Reads;  // blocks read
+  uint64_t Writes; // blocks written
+  uint64_t Cycles;
+} DRAMStats;
+
+typedef struct BufferStats {
+  uint64_t Stores;      // writes from L1 entering the buffer
+  uint64_t Coalesced;   // of which merged into an entry already waiting
+  uint64_t Drains;      // entries written to L2
+  uint64_t StallCycles; // time spent waiting for a full buffer
+  uint64_t DrainCycles; // L2 and DRAM time of the drains, hidden behind execution
+} BufferStats;
+
+typedef struct MissStats {
+  uint64_t Misses;      // L1 misses and prefetches that took an MSHR
+  uint64_t Merges;      // accesses to a block whose miss was still outstanding
+  uint64_t Dropped;     // L1 prefetches dropped for lack of an MSHR
+  uint64_t Peak;        // most misses outstanding at once
+  uint64_t StallCycles; // time spent waiting for a free MSHR or the last misses
+  uint64_t MissCycles;  // latency of all the misses, overlapped or not
+  uint64_t BusyCycles;  // time with at least one miss outstanding
+} MissStats;
+
+/* Bus traffic between the L1s, only with several cores. */
+typedef struct CoherenceStats {
+  uint64_t Reads;            // L1 fills, snooped by the other L1s
+  uint64_t ReadExclusives;   // fills for stores and stores past L1, invalidating other copies
+  uint64_t Upgrades;         // stores to shared lines, invalidating the other copies
+  uint64_t Invalidations;    // lines other L1s lost to those
+  uint64_t Interventions;    // modified lines written back because another L1 wanted them
+  uint64_t BusCycles;        // time spent on bus transactions
+  uint64_t ContentionCycles; // time spent waiting for the bus
+} CoherenceStats;
+
+typedef struct VictimStats {
+  uint64_t Hits;       // L1 misses found in the victim cache
+  uint64_t Misses;     // L1 misses that went on to L2
+  uint64_t Evictions;  // entries pushed out by newer victims
+  uint64_t Writebacks; // of which dirty, written to L2
+  uint64_t Cycles;
+} VictimStats;
+
+/* Traffic between L1 and L2 caused by the inclusion policy. */
+typedef struct InclusionStats {
+  uint64_t BackInvalidations; // L1 lines dropped because L2 evicted their block, inclusive only
+  uint64_t BackWritebacks;    // of which dirty, merged into the evicted L2 line
+  uint64_t Moves;             // L2 hits handed over to L1 and dropped from L2, exclusive only
+  uint64_t CleanVictims;      // clean L1 evictions written into L2, exclusive only
+} InclusionStats;
+
+typedef struct Stats {
+  LevelStats l1; // all cores together
+  VictimStats victim;
+  LevelStats l2;
+  DRAMStats dram;
+  BufferStats buffer;
+  MissStats mshr;
+  CoherenceStats coherence;
+  InclusionStats inclusion;
+} Stats;
+
+/*
+How L1 handles stores. All zeros is the original behaviour: write-back,
+write-allocate and no write buffer.
+
+With WriteThrough, every store to L1 is also sent to L2 and L1 lines
+never become dirty. With NoWriteAllocate, a store that misses in L1 is
+sent to L2 without bringing the block into L1.
+
+With BufferEntries > 0, whatever L1 sends to L2 (write-through stores,
+stores that bypass L1 and dirty evictions) goes into a coalescing write
+buffer of that many L1 blocks instead of waiting for L2. Stores to a
+block already in the buffer are merged into its entry. The buffer
+drains in FIFO order in the background, one entry at a time, each
+drain keeping L2 busy for as long as the write takes (including any
+DRAM traffic it causes); that time is not added to the simulated time.
+A store that finds the buffer full waits for the oldest entry to start
+draining, and that wait does count. L1 misses see the newest data, as
+blocks fetched from L2 are merged with any buffered stores to them.
+*/
+typedef struct WritePolicy {
+  uint32_t WriteThrough;
+  uint32_t NoWriteAllocate;
+  uint32_t BufferEntries;
+} WritePolicy;
+
+#define MAX_WRITE_BUFFER 64                          // entries
+#define BLOCK_MASK_WORDS (MAX_BLOCK_SIZE / WORD_SIZE / 64) // words of a per-word bitmap
+
+typedef struct WriteBufferEntry {
+  uint64_t Address;                // of the L1 block
+  uint64_t Queued;                 // time the entry was created
+  uint64_t Mask[BLOCK_MASK_WORDS]; // words of the block holding stored data
+  uint8_t Data[MAX_BLOCK_SIZE];
+} WriteBufferEntry;
+
+typedef struct WriteBuffer {
+  WriteBufferEntry *entries; // ring of BufferEntries entries, oldest at head
+  uint32_t head;
+  uint32_t count;
+  uint64_t portFree; // time at which L2 finishes the last drain started
+} WriteBuffer;
+
+/*
+Miss status holding registers of L1. With none (the default) L1 is
+blocking: a miss adds its whole latency to the time before the next
+access starts.
+
+With MSHRs, a miss (or an L1 prefetch) takes one and the access goes
+on as soon as the miss is issued; the block is in L1 straight away as
+far as data goes, but the miss only completes after its latency, and
+the MSHR stays taken until then. Accesses to the block in between are
+merged into the MSHR. A miss that finds every MSHR taken waits for the
+first one to complete, and a prefetch is dropped. So up to that many
+misses overlap, and the time reflects the memory-level parallelism of
+the trace. Misses below L1 are still served one at a time.
+*/
+#define MAX_MSHRS 64
+
+typedef struct MSHR {
+  uint64_t Block;     // L1 block number
+  uint64_t Issued;    // time the miss was issued
+  uint64_t Completes; // time the block arrives
+} MSHR;
+
+typedef struct MSHRFile {
+  MSHR entries[MAX_MSHRS]; // the first count are taken
+  uint32_t count;
+  uint64_t busyUntil; // latest completion so far
+} MSHRFile;
+
+/*
+What each core has to itself: an L1 with its write buffer and MSHRs,
+and its own clock.
+
+The cores share L2 and sit on a snooping bus that keeps their L1s
+coherent with MESI. Every L1 fill, and every store to a shared line or
+one going past L1, is a bus transaction: it waits for the bus to be
+free, takes Snoop cycles and is seen by every other L1. A read leaves
+the other copies shared (modified ones are written back to L2 first),
+anything for a store invalidates them. Buffered stores and stream
+buffer blocks of the other cores are snooped too. With a single core
+there is no bus and none of this costs anything.
+*/
+#define MAX_CORES 16
+
+/*
+How the contents of L2 relate to those of the L1s (their victim caches
+included):
+
+  NINE       neither inclusive nor exclusive, the default. L1 fills
+             leave a copy in L2 and L2 evicts without looking at L1.
+  INCLUSIVE  every L1 block is also in L2. When L2 evicts a block it
+             back-invalidates it in every L1, merging modified copies
+             into the line it writes back.
+  EXCLUSIVE  a block is in L1 or L2, not both. An L1 fill takes the
+             block out of L2 (it arrives dirty if it was dirty there),
+             or gets it straight from DRAM without a copy in L2. Every
+             line L1 evicts, clean or dirty, goes to L2 in exchange.
+             L1 and L2 blocks must be the same size.
+
+Stores that reach L2 a word at a time (write-through and stores past
+L1) and snooped writebacks allocate in L2 under every policy, as do
+stream buffer fetches, which copy blocks rather than move them.
+*/
+#define INCLUSION_NINE 0
+#define INCLUSION_INCLUSIVE 1
+#define INCLUSION_EXCLUSIVE 2
+#define INCLUSION_COUNT 3
+
+typedef struct Core {
+  Cache l1_cache;
+  WriteBuffer write_buffer;
+  MSHRFile mshr_file;
+  uint64_t time; // while another core is running
+} Core;
+
+/*
+Everything one memory hierarchy needs. Every function below takes the
+simulator it works on, so independent simulators can live in the same
+process and run on different threads without locking.
+
+Addresses are 64 bits wide. The DRAM is sparse (see Memory.h), so the
+whole address space can be used; memory_limit is the last valid byte
+address, and accesses past it are rejected rather than simulated.
+
+Accesses come from one core at a time, core, whose clock is time.
+*/
+typedef struct Simulator {
+  Core cores[MAX_CORES];
+  Core *core;
+  uint32_t core_count;
+  Cache l2_cache;
+  Memory DRAM; // pages allocated on first write, never in timing-only mode
+  uint64_t memory_limit;
+  Latencies latency;
+  WritePolicy write_policy;
+  uint32_t mshrs; // 0 for a blocking L1
+  uint32_t inclusion;
+  uint64_t busFree; // time the bus finishes its last transaction
+  Stats stats;
+  uint64_t time;
+  uint32_t timing_only;
+} Simulator;
+
+/* Sets up an empty simulator with the geometry from Cache.h. */
+void initSimulator(Simulator *);
+
+/* Releases everything the simulator allocated and resets it. */
+void freeSimulator(Simulator *);
+
+/*
+Checks a simulator that comes from outside, such as a loaded
+checkpoint: every setting has to be one the set functions accept, the
+derived fields of each geometry what they would be, and the counts and
+policy state of every level within the arrays they index. Returns 0,
+or -1 if anything is off.
+*/
+int checkSimulator(const Simulator *);
+
+void resetTime(Simulator *);
+
+/* The latest clock of all cores, i.e. the time by which all of them are done. */
+uint64_t getTime(Simulator *);
+
+uint64_t getCoreTime(Simulator *, uint32_t);
+
+/*
+Statistics since the simulator was set up or last reset. The cycles of
+all levels (the victim cache included) plus the write buffer, prefetch
+and MSHR stall cycles and the bus cycles add up to the time of all
+cores together, as long as both are reset together.
+*/
+void getStats(Simulator *, Stats *);
+
+void resetStats(Simulator *);
+
+/* Writes a human-readable summary of the statistics. */
+void printStats(Simulator *, FILE *);
+
+/*
+Changes the geometry of both levels. Returns 0 on success and -1 if
+either geometry is invalid (or the block sizes differ in an exclusive
+hierarchy), in which case nothing is changed. The caches are
+reinitialized (empty) on their next access.
+*/
+int configureCaches(Simulator *, const CacheGeometry *, const CacheGeometry *);
+
+/*
+Policy names as used on the command line: "lru", "plru", "nru",
+"srrip", "brrip" and "random". parsePolicy returns -1 for unknown ones.
+*/
+int parsePolicy(const char *);
+
+const char *policyName(uint32_t);
+
+/*
+In timing-only mode the caches track tags, state and latency but never
+store or move data: the data arrays and DRAM are not allocated, and
+read() leaves its buffer untouched. Changing the mode empties both
+levels.
+*/
+void setTimingOnly(Simulator *, uint32_t);
+
+/*
+Gives the simulator count cores (see Core), emptying every L1. Returns
+-1 if count is 0 or over MAX_CORES. Accesses come from core 0 until
+selectCore says otherwise.
+*/
+int setCores(Simulator *, uint32_t);
+
+/*
+Makes the following accesses come from the given core, which carries
+on from its own clock. Returns -1 for a core we don't have.
+*/
+int selectCore(Simulator *, uint32_t);
+
+/*
+Changes how L1 handles stores (see WritePolicy). Returns 0 on success
+and -1 if the buffer would have more than MAX_WRITE_BUFFER entries.
+Anything still in the old write buffer is drained first.
+*/
+int setWritePolicy(Simulator *, const WritePolicy *);
+
+/*
+Sets up the prefetcher of level 1 or 2 (see Prefetch.h); a Type of
+PREFETCH_NONE turns it off. Returns 0 on success and -1 on an invalid
+level or configuration. The level is emptied.
+*/
+int setPrefetcher(Simulator *, uint32_t, const PrefetchConfig *);
+
+/*
+Prefetcher names as used on the command line: "none", "next", "stride"
+and "stream". Returns -1 for unknown ones.
+*/
+int parsePrefetcher(const char *);
+
+/*
+Gives L1 count MSHRs, 0 making it blocking again (see MSHRFile).
+Returns -1 if count is over MAX_MSHRS. Outstanding misses are waited
+for first.
+*/
+int setMSHRs(Simulator *, uint32_t);
+
+/*
+Sets the inclusion policy (INCLUSION_ constants), emptying both levels.
+Returns -1 for an unknown policy, or for EXCLUSIVE if the L1 and L2
+blocks differ in size.
+*/
+int setInclusion(Simulator *, uint32_t);
+
+/*
+Inclusion policy names as used on the command line: "nine", "inclusive"
+and "exclusive". parseInclusion returns -1 for unknown ones.
+*/
+int parseInclusion(const char *);
+
+const char *inclusionName(uint32_t);
+
+/*
+Gives every L1 a victim cache of count entries, 0 removing it (see
+VictimCache). Returns -1 if count is over MAX_VICTIMS. Every L1 is
+emptied.
+*/
+int setVictimCache(Simulator *, uint32_t);
+
+/*
+Waits for every outstanding miss to complete, advancing the time to
+the last completion (e.g. at the end of a run).
+*/
+void waitForMisses(Simulator *);
+
+/*
+Drains every entry of the write buffer into L2 right away, without
+adding to the time (e.g. at the end of a run).
+*/
+void flushWriteBuffer(Simulator *);
+
+/*
+Limits the simulated memory to the given number of bytes, or to the
+whole 64-bit address space (the default) if it is 0.
+*/
+void setMemorySize(Simulator *, uint64_t);
+
+/****************  RAM memory (byte addressable) ***************/
+void accessDRAM(Simulator *, uint64_t, uint8_t *, uint32_t);
+
+void initL1Cache(Simulator *);
+void initL2Cache(Simulator *);
+void accessL1(Simulator *, uint64_t, uint8_t *, uint32_t);
+void accessL2(Simulator *, uint64_t, uint8_t *, uint32_t);
 
 /*********************** Interfaces *************************/
 
-void read(uint32_t, uint8_t *);
+/*
+Both return 0, or -1 without simulating anything if the word at the
+address doesn't fit in the simulated memory. While a capture is running
+(see Capture.h) every access is recorded, rejected ones included; the
+same goes for the batch versions below.
+*/
+int read(Simulator *, uint64_t, uint8_t *);
+
+int write(Simulator *, uint64_t, uint8_t *);
+
+/*
+Batch versions of the above: count accesses to addresses[i], with word
+i of data read into or written from (data may be NULL, in which case
+reads are dropped and writes store 0). accessBatch takes a MODE_READ or
+MODE_WRITE per access in its third argument. They return how many
+accesses were rejected for falling outside the simulated memory.
+*/
+uint32_t accessBatch(Simulator *, const uint64_t *, const uint8_t *, uint8_t *, uint32_t);
+
+uint32_t readBatch(Simulator *, const uint64_t *, uint8_t *, uint32_t);
+
+uint32_t writeBatch(Simulator *, const uint64_t *, uint8_t *, uint32_t);
 
-void write(uint32_t, uint8_t *);
+/*
+Functional warming: leaves the cache contents as accessBatch would,
+but without advancing the time or counting anything, and for a
+fraction of the cost (see L2_2WCache.c for what is left out). Meant for
+a timing-only simulator with a single core, as the data and the other
+cores' copies aren't kept up to date. Returns how many accesses were
+rejected for falling outside the simulated memory.
+*/
+uint32_t warmBatch(Simulator *, const uint64_t *, const uint8_t *, uint32_t);
 
 #endif
@@ -1,53 +0,0 @@
-#ifndef L2_2WCACHE_H
-#define L2_2WCACHE_H
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <stdint.h>
-#include "Cache.h"
-
-#ifdef DEBUG
-    #define DEBUG_PRINT(...) printf(__VA_ARGS__)
-#else
-    #define DEBUG_PRINT(...)
-#endif
-
-void resetTime();
-
-uint32_t getTime();
-
-/****************  RAM memory (byte addressable) ***************/
-void accessDRAM(uint32_t, uint8_t *, uint32_t);
-
-/*********************** Cache *************************/
-
-void initL1Cache();
-void initL2Cache();
-void accessL1(uint32_t, uint8_t *, uint32_t);
-void accessL2(uint32_t, uint8_t *, uint32_t);
-
-typedef struct CacheLine {
-  uint8_t Valid;
-  uint8_t Dirty;
-  uint32_t Tag;
-  uint32_t Time; // Timestamp used for LRU policy
-} CacheLine;
-
-typedef struct CacheL1 {
-  uint32_t init;
-  CacheLine lines[L1_SIZE / BLOCK_SIZE];
-} CacheL1;
-
-typedef struct CacheL2 {
-  uint32_t init;
-  CacheLine lines[L2_SIZE / BLOCK_SIZE];
-} CacheL2;
-
-/*********************** Interfaces *************************/
-
-void read(uint32_t, uint8_t *);
-
-void write(uint32_t, uint8_t *);
-
-#endif
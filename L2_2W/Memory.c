@@ -0,0 +1,128 @@
+#include "Memory.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define EMPTY_PAGE UINT64_MAX // never a page number, pages are > 1 byte
+#define INITIAL_PAGES 64
+
+#define PAGE_BITS __builtin_ctz(DRAM_PAGE_SIZE)
+
+/* Murmur3 64-bit finalizer. */
+static uint64_t mixPage(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+/* Slot holding number, or the free slot where it would go. */
+static uint64_t findSlot(const Memory *memory, uint64_t number) {
+
+  uint64_t slot = mixPage(number) & (memory->tableSize - 1);
+
+  while (memory->pageNumbers[slot] != EMPTY_PAGE && memory->pageNumbers[slot] != number)
+    slot = (slot + 1) & (memory->tableSize - 1);
+  return slot;
+}
+
+static void growTable(Memory *memory) {
+
+  uint64_t oldSize = memory->tableSize, *oldNumbers = memory->pageNumbers;
+  uint8_t **oldPages = memory->pages;
+
+  memory->tableSize = oldSize ? oldSize * 2 : INITIAL_PAGES;
+  memory->pageNumbers = malloc(memory->tableSize * sizeof(uint64_t));
+  memory->pages = malloc(memory->tableSize * sizeof(uint8_t *));
+  if (memory->pageNumbers == NULL || memory->pages == NULL)
+    exit(-1);
+  memset(memory->pageNumbers, 0xff, memory->tableSize * sizeof(uint64_t));
+
+  for (uint64_t i = 0; i < oldSize; i++) {
+    if (oldNumbers[i] == EMPTY_PAGE)
+      continue;
+    uint64_t slot = findSlot(memory, oldNumbers[i]);
+    memory->pageNumbers[slot] = oldNumbers[i];
+    memory->pages[slot] = oldPages[i];
+  }
+
+  free(oldNumbers);
+  free(oldPages);
+}
+
+/*
+Returns the page holding address. If it doesn't exist yet it is
+allocated when create is set, otherwise NULL is returned.
+*/
+static uint8_t *findPage(Memory *memory, uint64_t address, uint32_t create) {
+
+  uint64_t number = address >> PAGE_BITS, slot;
+
+  if (memory->lastPage != NULL && memory->lastNumber == number)
+    return memory->lastPage;
+
+  if (memory->tableSize == 0) {
+    if (!create)
+      return NULL;
+    growTable(memory);
+  }
+
+  slot = findSlot(memory, number);
+  if (memory->pageNumbers[slot] == EMPTY_PAGE) {
+    if (!create)
+      return NULL;
+
+    // Keep the table at most half full
+    if ((memory->used + 1) * 2 > memory->tableSize) {
+      growTable(memory);
+      slot = findSlot(memory, number);
+    }
+
+    memory->pageNumbers[slot] = number;
+    memory->pages[slot] = calloc(DRAM_PAGE_SIZE, 1);
+    if (memory->pages[slot] == NULL)
+      exit(-1);
+    memory->used++;
+  }
+
+  memory->lastNumber = number;
+  memory->lastPage = memory->pages[slot];
+  return memory->lastPage;
+}
+
+void readMemory(Memory *memory, uint64_t address, uint8_t *data, uint32_t length) {
+
+  uint8_t *page = findPage(memory, address, 0);
+
+  if (page == NULL)
+    memset(data, 0, length);
+  else
+    memcpy(data, &page[address & (DRAM_PAGE_SIZE - 1)], length);
+}
+
+void writeMemory(Memory *memory, uint64_t address, const uint8_t *data, uint32_t length) {
+
+  uint8_t *page = findPage(memory, address, 1);
+
+  memcpy(&page[address & (DRAM_PAGE_SIZE - 1)], data, length);
+}
+
+uint64_t nextPage(const Memory *memory, uint64_t slot) {
+
+  while (slot < memory->tableSize && memory->pageNumbers[slot] == EMPTY_PAGE)
+    slot++;
+  return slot;
+}
+
+void freeMemory(Memory *memory) {
+
+  for (uint64_t i = 0; i < memory->tableSize; i++) {
+    if (memory->pageNumbers[i] != EMPTY_PAGE)
+      free(memory->pages[i]);
+  }
+  free(memory->pageNumbers);
+  free(memory->pages);
+  memset(memory, 0, sizeof(*memory));
+}
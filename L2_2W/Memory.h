@@ -0,0 +1,48 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <stdint.h>
+
+/*
+Sparse backing store for the simulated DRAM. The 64-bit address space
+is split into DRAM_PAGE_SIZE pages, and a page is only allocated (and
+zeroed) the first time something is written to it; reading a page that
+was never written gives zeros without allocating anything. So memory
+use follows the footprint a trace actually touches, not the size of
+the address space.
+
+Pages are found through an open-addressing hash table from page number
+to page, plus a one-entry cache of the last page used, which catches
+the common case of consecutive blocks on the same page.
+
+Cache blocks are at most MAX_BLOCK_SIZE bytes and aligned to their
+size, so a block never straddles two pages.
+*/
+
+#define DRAM_PAGE_SIZE 4096 // in bytes, a power of two >= MAX_BLOCK_SIZE
+
+typedef struct Memory {
+  uint64_t *pageNumbers; // hash table keys, EMPTY_PAGE for a free slot
+  uint8_t **pages;       // hash table values
+  uint64_t tableSize;    // slots, a power of two (0 until first write)
+  uint64_t used;         // pages allocated
+  uint64_t lastNumber;   // last page looked up, valid if lastPage != NULL
+  uint8_t *lastPage;
+} Memory;
+
+/* Copies length bytes at address into data (zeros if never written). */
+void readMemory(Memory *, uint64_t, uint8_t *, uint32_t);
+
+/* Copies length bytes from data to address, allocating its page. */
+void writeMemory(Memory *, uint64_t, const uint8_t *, uint32_t);
+
+/*
+For walking every page allocated: returns the first slot of the table
+from the given one on that holds a page, or tableSize if none does.
+*/
+uint64_t nextPage(const Memory *, uint64_t);
+
+/* Releases every page; the memory reads as zeros again. */
+void freeMemory(Memory *);
+
+#endif
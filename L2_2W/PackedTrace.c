@@ -0,0 +1,282 @@
+#include "PackedTrace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+Like Trace.c, this file is kept apart from the simulator because of
+the read() and write() in <unistd.h>.
+*/
+
+/*********************** Reading *************************/
+
+int openPackedTrace(const char *path, PackedTrace *trace) {
+
+  struct stat st;
+  const PackedHeader *header;
+  uint64_t last = 0;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  if ((size_t)st.st_size < sizeof(PackedHeader)) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+
+  trace->length = (size_t)st.st_size;
+  trace->base = mmap(NULL, trace->length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (trace->base == MAP_FAILED)
+    return -1;
+
+  /*
+  Besides the header we check that the index fits in the file and that
+  its offsets run forwards through the records, so the decoder only has
+  to watch for the end of the records.
+  */
+  header = (const PackedHeader *)trace->base;
+  int valid = header->Magic == PACKED_MAGIC && header->Version == PACKED_VERSION &&
+              header->BlockRecords != 0 &&
+              header->Blocks == (header->Count + header->BlockRecords - 1) / header->BlockRecords &&
+              header->IndexOffset >= sizeof(PackedHeader) && header->IndexOffset % 8 == 0 &&
+              header->IndexOffset <= trace->length &&
+              header->Blocks <= (trace->length - header->IndexOffset) / sizeof(uint64_t);
+
+  if (valid) {
+    trace->index = (const uint64_t *)((const uint8_t *)trace->base + header->IndexOffset);
+    last = sizeof(PackedHeader);
+    for (uint64_t b = 0; b < header->Blocks && valid; b++) {
+      valid = trace->index[b] >= last && trace->index[b] <= header->IndexOffset;
+      last = trace->index[b];
+    }
+  }
+
+  if (!valid) {
+    munmap(trace->base, trace->length);
+    errno = EINVAL;
+    return -1;
+  }
+
+  madvise(trace->base, trace->length, MADV_SEQUENTIAL);
+
+  trace->data = (const uint8_t *)trace->base;
+  trace->count = header->Count;
+  trace->blocks = header->Blocks;
+  trace->blockRecords = header->BlockRecords;
+  trace->end = header->IndexOffset;
+  return 0;
+}
+
+int closePackedTrace(PackedTrace *trace) {
+
+  int ret = munmap(trace->base, trace->length);
+
+  memset(trace, 0, sizeof(*trace));
+  return ret;
+}
+
+int seekPackedTrace(const PackedTrace *trace, PackedCursor *cursor, uint64_t record) {
+
+  uint64_t block = record / trace->blockRecords;
+  TraceRecord skipped[64];
+
+  if (record > trace->count)
+    return -1;
+
+  cursor->record = block * trace->blockRecords;
+  cursor->offset = block < trace->blocks ? trace->index[block] : trace->end;
+  cursor->address = 0;
+
+  // Within the block there is nothing for it but to decode our way there
+  while (cursor->record < record) {
+    uint64_t left = record - cursor->record;
+
+    if (decodePackedTrace(trace, cursor, skipped, left < 64 ? (uint32_t)left : 64) == 0)
+      return -1;
+  }
+  return 0;
+}
+
+/*
+Decodes one record at p, of which at least PACKED_MAX_RECORD bytes are
+readable, and returns the byte after it.
+*/
+static inline const uint8_t *decodeRecord(const uint8_t *p, uint64_t *address,
+                                          TraceRecord *record) {
+
+  uint32_t op = *p++;
+  uint64_t delta = (op >> 2) & 0x1f;
+
+  if (op & 0x80) {
+    uint32_t shift = 5;
+    uint32_t byte;
+
+    do {
+      byte = *p++;
+      delta |= (uint64_t)(byte & 0x7f) << shift;
+      shift += 7;
+    } while ((byte & 0x80) && shift < 64);
+  }
+
+  *address += (delta >> 1) ^ (0 - (delta & 1));
+  record->Address = *address;
+  record->Mode = (uint8_t)(op & 1);
+  record->Width = (op & 2) ? *p++ : PACKED_WIDTH;
+  memset(record->Reserved, 0, sizeof(record->Reserved));
+  return p;
+}
+
+uint32_t decodePackedTrace(const PackedTrace *trace, PackedCursor *cursor, TraceRecord *records,
+                           uint32_t max) {
+
+  const uint8_t *p = trace->data + cursor->offset;
+  const uint8_t *end = trace->data + trace->end;
+  uint64_t address = cursor->address;
+  uint32_t count = 0;
+
+  if (max > trace->count - cursor->record)
+    max = (uint32_t)(trace->count - cursor->record);
+
+  while (count < max) {
+    uint64_t inBlock = cursor->record % trace->blockRecords;
+    uint32_t stop = count + (uint32_t)(trace->blockRecords - inBlock < max - count
+                                           ? trace->blockRecords - inBlock
+                                           : max - count);
+    uint32_t start = count;
+
+    if (inBlock == 0)
+      address = 0;
+
+    /*
+    Away from the end of the records a record can't run past it, so
+    we only check for that in the last few bytes, where we decode
+    from a zero-padded copy instead.
+    */
+    while (count < stop && end - p >= PACKED_MAX_RECORD)
+      p = decodeRecord(p, &address, &records[count++]);
+
+    while (count < stop) {
+      uint8_t tail[PACKED_MAX_RECORD] = {0};
+      size_t left = (size_t)(end - p);
+      uint64_t next = address;
+      size_t used;
+
+      memcpy(tail, p, left < sizeof(tail) ? left : sizeof(tail));
+      used = (size_t)(decodeRecord(tail, &next, &records[count]) - tail);
+      if (left == 0 || used > left)
+        break;
+      p += used;
+      address = next;
+      count++;
+    }
+
+    cursor->record += count - start;
+    if (count < stop)
+      break;
+  }
+
+  cursor->offset = (uint64_t)(p - trace->data);
+  cursor->address = address;
+  return count;
+}
+
+/*********************** Writing *************************/
+
+int beginPackedTrace(PackedWriter *writer, FILE *file, uint32_t blockRecords) {
+
+  PackedHeader header = {0};
+
+  if (blockRecords == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  memset(writer, 0, sizeof(*writer));
+  writer->file = file;
+  writer->blockRecords = blockRecords;
+
+  // A placeholder, endPackedTrace fills in the real one
+  if (fwrite(&header, sizeof(header), 1, file) != 1)
+    return -1;
+  writer->offset = sizeof(header);
+  return 0;
+}
+
+int packRecord(PackedWriter *writer, const TraceRecord *record) {
+
+  uint8_t bytes[PACKED_MAX_RECORD];
+  uint32_t length = 0;
+  uint64_t delta, zigzag;
+
+  if (record->Mode > 1) {
+    errno = EINVAL;
+    return -1;
+  }
+
+  if (writer->count % writer->blockRecords == 0) {
+    if (writer->count / writer->blockRecords == writer->capacity) {
+      uint64_t capacity = writer->capacity ? writer->capacity * 2 : 64;
+      uint64_t *index = realloc(writer->index, capacity * sizeof(uint64_t));
+
+      if (index == NULL)
+        exit(-1);
+      writer->index = index;
+      writer->capacity = capacity;
+    }
+    writer->index[writer->count / writer->blockRecords] = writer->offset;
+    writer->address = 0;
+  }
+
+  delta = record->Address - writer->address;
+  zigzag = (delta << 1) ^ (0 - (delta >> 63));
+
+  bytes[length++] = (uint8_t)(((zigzag & 0x1f) << 2) | (zigzag > 0x1f ? 0x80 : 0) |
+                              (record->Width != PACKED_WIDTH ? 2 : 0) | record->Mode);
+  for (zigzag >>= 5; zigzag != 0; zigzag >>= 7)
+    bytes[length++] = (uint8_t)((zigzag & 0x7f) | (zigzag > 0x7f ? 0x80 : 0));
+  if (record->Width != PACKED_WIDTH)
+    bytes[length++] = record->Width;
+
+  if (fwrite(bytes, 1, length, writer->file) != length)
+    return -1;
+  writer->offset += length;
+  writer->address = record->Address;
+  writer->count++;
+  return 0;
+}
+
+int endPackedTrace(PackedWriter *writer) {
+
+  uint64_t blocks = (writer->count + writer->blockRecords - 1) / writer->blockRecords;
+  uint8_t padding[8] = {0};
+  size_t pad = (size_t)((8 - writer->offset % 8) % 8);
+  PackedHeader header = {PACKED_MAGIC, PACKED_VERSION, writer->count, blocks,
+                         writer->offset + pad, writer->blockRecords, 0};
+  int ret = 0;
+
+  // The index is padded to 8 bytes so that it can be used in place
+  if (fwrite(padding, 1, pad, writer->file) != pad ||
+      fwrite(writer->index, sizeof(uint64_t), blocks, writer->file) != blocks ||
+      fseek(writer->file, 0, SEEK_SET) < 0 ||
+      fwrite(&header, sizeof(header), 1, writer->file) != 1 || fflush(writer->file) != 0)
+    ret = -1;
+
+  writer->offset += pad + blocks * sizeof(uint64_t);
+  free(writer->index);
+  writer->index = NULL;
+  return ret;
+}
@@ -0,0 +1,108 @@
+#ifndef PACKED_TRACE_H
+#define PACKED_TRACE_H
+
+#include <stdio.h>
+#include "Trace.h"
+
+/*
+Compressed ("packed") trace format. A packed trace is a PackedHeader,
+the records one after the other, and an index of where each block of
+BlockRecords records starts. All integers are little-endian.
+
+Every record starts with an op byte:
+
+  bit 0     mode, MODE_READ (1) or MODE_WRITE (0)
+  bit 1     set if a width byte follows, otherwise the width is
+            PACKED_WIDTH
+  bits 2-6  the low 5 bits of the address delta
+  bit 7     set if more delta bits follow
+
+The address delta is the difference from the previous record's address,
+zigzag encoded (0, -1, 1, -2... become 0, 1, 2, 3...) and continued as
+a little-endian base-128 varint after the op byte, 7 bits per byte with
+the top bit set on all but the last. So a word access next to the last
+one takes a single byte, a 64-byte stride two.
+
+The address starts again from 0 at the start of every block, so any
+block can be decoded on its own, which is what seeking relies on.
+*/
+
+#define PACKED_MAGIC 0x31525450 // "PTR1"
+#define PACKED_VERSION 1
+#define PACKED_WIDTH 4            // width of records without a width byte
+#define PACKED_BLOCK_RECORDS 4096 // default records per block
+#define PACKED_MAX_RECORD 11      // bytes: op byte, 9 delta bytes and a width
+
+typedef struct PackedHeader {
+  uint32_t Magic;
+  uint32_t Version;
+  uint64_t Count;        // records
+  uint64_t Blocks;       // ceil(Count / BlockRecords)
+  uint64_t IndexOffset;  // of Blocks 64-bit file offsets, one per block
+  uint32_t BlockRecords; // records per block, the last one may have fewer
+  uint32_t Reserved;
+} PackedHeader;
+
+typedef struct PackedTrace {
+  const uint8_t *data;  // start of the mapping
+  const uint64_t *index;
+  uint64_t count;
+  uint64_t blocks;
+  uint32_t blockRecords;
+  uint64_t end;         // offset of the index, where the records stop
+  void *base;           // start of the mapping
+  size_t length;        // length of the mapping
+} PackedTrace;
+
+/* Where a decoder has got to in a packed trace. */
+typedef struct PackedCursor {
+  uint64_t offset;  // of the next record in the file
+  uint64_t record;  // number of the next record
+  uint64_t address; // of the previous record in the block
+} PackedCursor;
+
+/*
+Both return 0 on success and -1 (with errno set) on failure. A file
+that isn't a packed trace fails with EINVAL.
+*/
+int openPackedTrace(const char *, PackedTrace *);
+int closePackedTrace(PackedTrace *);
+
+/*
+Puts the cursor on the given record, 0 being the start of the trace.
+Returns -1 if the trace has no such record.
+*/
+int seekPackedTrace(const PackedTrace *, PackedCursor *, uint64_t);
+
+/*
+Decodes up to max records from the cursor on, moving it past them.
+Returns how many, 0 at the end of the trace. A record that would run
+past the records' end ends the trace early.
+*/
+uint32_t decodePackedTrace(const PackedTrace *, PackedCursor *, TraceRecord *, uint32_t);
+
+/*
+Writes a packed trace one record at a time to a file, which has to be
+seekable: the header is only filled in by endPackedTrace.
+*/
+typedef struct PackedWriter {
+  FILE *file;
+  uint64_t count;
+  uint64_t address; // of the previous record in the block
+  uint64_t offset;  // bytes written so far
+  uint64_t *index;  // block offsets so far
+  uint64_t capacity;
+  uint32_t blockRecords;
+} PackedWriter;
+
+/*
+All three return 0 on success and -1 (with errno set) on failure.
+packRecord rejects records whose mode is neither MODE_READ nor
+MODE_WRITE. endPackedTrace writes the index and the header, after
+which offset is the size of the file; the file is left open.
+*/
+int beginPackedTrace(PackedWriter *, FILE *, uint32_t);
+int packRecord(PackedWriter *, const TraceRecord *);
+int endPackedTrace(PackedWriter *);
+
+#endif
@@ -0,0 +1,115 @@
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include <stdint.h>
+
+/*
+Hardware prefetcher models, one per cache level. A prefetcher is
+trained by demand misses and by demand hits on lines it brought in,
+and answers with blocks to fetch ahead of time:
+
+  NEXT_LINE  the Degree blocks following the one accessed.
+  STRIDE     a table of Entries streams, one per 4 KiB region (we have
+             no program counters to tell streams apart). Once the same
+             block stride is seen twice in a row in a region, the next
+             Degree blocks along that stride are fetched.
+  STREAM     Entries stream buffers of Degree blocks each, kept beside
+             the cache rather than in it. A miss found in a stream
+             buffer is moved into the cache and the buffer tops itself
+             up; a miss found nowhere restarts the least recently used
+             buffer after the missing block.
+
+Prefetches are issued in the background: they don't add to the time,
+but a block only becomes usable once its fetch would have finished,
+and a demand access that gets there first waits for the rest.
+*/
+
+#define PREFETCH_NONE 0
+#define PREFETCH_NEXT_LINE 1
+#define PREFETCH_STRIDE 2
+#define PREFETCH_STREAM 3
+#define PREFETCH_COUNT 4
+
+#define MAX_PREFETCH_DEGREE 16
+#define MAX_PREFETCH_ENTRIES 256
+#define STRIDE_REGION_BITS 12 // streams are told apart by 4 KiB region
+
+typedef struct PrefetchConfig {
+  uint32_t Type;
+  uint32_t Degree;  // blocks fetched ahead, or blocks per stream buffer
+  uint32_t Entries; // stride table entries, or stream buffers
+} PrefetchConfig;
+
+typedef struct StrideEntry {
+  uint64_t Region;
+  uint64_t LastBlock;
+  int64_t Stride;      // in blocks
+  uint32_t Confidence; // times in a row Stride was seen
+} StrideEntry;
+
+/*
+A stream buffer is a FIFO of up to Degree blocks, the oldest at head.
+Next is the block it will fetch when it has room again.
+*/
+typedef struct StreamBuffer {
+  uint64_t Next;
+  uint64_t LastUse; // for choosing which buffer to restart
+  uint32_t head;
+  uint32_t count;
+} StreamBuffer;
+
+typedef struct Prefetcher {
+  PrefetchConfig config;
+  StrideEntry *strides;  // Entries, STRIDE only
+  StreamBuffer *streams; // Entries, STREAM only
+  uint64_t *blocks;      // Degree per stream buffer, block numbers
+  uint64_t *ready;       // Degree per stream buffer, time each block arrives
+  uint8_t *data;         // Degree blocks per stream buffer, NULL if timing-only
+  uint64_t clock;        // stream buffer use stamps
+  uint32_t last;         // stream buffer used most recently
+} Prefetcher;
+
+/*
+Trains a NEXT_LINE or STRIDE prefetcher with an access to block and
+fills targets with up to Degree blocks to prefetch. Returns how many.
+*/
+static inline uint32_t prefetchTargets(Prefetcher *p, uint64_t block, uint32_t blockBits,
+                                       uint64_t *targets) {
+
+  uint32_t count = 0;
+
+  if (p->config.Type == PREFETCH_NEXT_LINE) {
+    for (uint32_t i = 1; i <= p->config.Degree; i++)
+      targets[count++] = block + i;
+    return count;
+  }
+
+  uint64_t region = (block << blockBits) >> STRIDE_REGION_BITS;
+  StrideEntry *entry = &p->strides[region % p->config.Entries];
+
+  if (entry->Region != region) {
+    *entry = (StrideEntry){region, block, 0, 0};
+    return 0;
+  }
+
+  if (block == entry->LastBlock)
+    return 0;
+
+  int64_t stride = (int64_t)(block - entry->LastBlock);
+
+  if (stride != 0 && stride == entry->Stride)
+    entry->Confidence += entry->Confidence < 3;
+  else
+    entry->Confidence = 0;
+  entry->Stride = stride;
+  entry->LastBlock = block;
+
+  if (entry->Confidence == 0)
+    return 0;
+
+  for (uint32_t i = 1; i <= p->config.Degree; i++)
+    targets[count++] = block + (uint64_t)(stride * (int64_t)i);
+  return count;
+}
+
+#endif
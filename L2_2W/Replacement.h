@@ -0,0 +1,245 @@
+#ifndef REPLACEMENT_H
+#define REPLACEMENT_H
+
+#include <stdint.h>
+
+/*
+Replacement policies. Each set keeps Words 64-bit words of policy
+state, and every operation below looks at that set's words only and
+takes constant time (tree-PLRU walks log2(ways) levels):
+
+  LRU     ways <= 16: the recency order as a stack of 4-bit way numbers,
+          most recent in the low nibble. Larger sets fall back to one
+          access stamp per way and an O(ways) scan for the oldest.
+  PLRU    tree-PLRU, one bit per internal node of a binary tree over
+          the ways pointing towards the half to evict next.
+  NRU     one "recently used" bit per way, cleared for all the others
+          when the last one gets set; we evict the first clear way.
+  SRRIP   2-bit re-reference prediction per way, kept as two bit planes
+  BRRIP   (low bits, high bits). Hits predict 0, SRRIP fills predict 2
+          and BRRIP fills 3 (2 once every BRRIP_LONG_ODDS fills). We
+          evict the first way predicting 3, ageing the set until one
+          does.
+  RANDOM  no state, the victim comes from a per-cache xorshift generator
+          so runs are reproducible.
+
+All of them need ways <= 64 (one bit per way in a word).
+
+Only the choice among valid lines is made here: lookupSet always fills
+invalid lines first.
+*/
+
+#define POLICY_LRU 0
+#define POLICY_PLRU 1
+#define POLICY_NRU 2
+#define POLICY_SRRIP 3
+#define POLICY_BRRIP 4
+#define POLICY_RANDOM 5
+#define POLICY_COUNT 6
+
+#define MAX_WAYS 64
+#define LRU_STACK_WAYS 16 // largest set whose LRU order fits in one word
+#define BRRIP_LONG_ODDS 32
+
+#define NIBBLES_1 0x1111111111111111ULL
+#define NIBBLES_8 0x8888888888888888ULL
+
+typedef struct Replacement {
+  uint32_t Policy;
+  uint32_t Words;  // of state per set
+  uint64_t *state; // Words * Sets words
+  uint64_t clock;  // access stamps, LRU beyond LRU_STACK_WAYS ways
+  uint64_t seed;   // RANDOM and BRRIP
+} Replacement;
+
+static inline uint64_t wayMask(uint32_t ways) {
+  return ways >= 64 ? ~0ULL : (1ULL << ways) - 1;
+}
+
+static inline uint64_t nextRandom(Replacement *r) {
+  r->seed ^= r->seed << 13;
+  r->seed ^= r->seed >> 7;
+  r->seed ^= r->seed << 17;
+  return r->seed;
+}
+
+static inline uint32_t replacementWords(uint32_t policy, uint32_t ways) {
+
+  switch (policy) {
+  case POLICY_LRU:
+    return ways <= LRU_STACK_WAYS ? 1 : ways;
+  case POLICY_SRRIP:
+  case POLICY_BRRIP:
+    return 2;
+  default:
+    return 1;
+  }
+}
+
+/* Puts one set in its initial state (all lines are invalid). */
+static inline void resetSet(Replacement *r, uint64_t *set, uint32_t ways) {
+
+  for (uint32_t w = 0; w < r->Words; w++)
+    set[w] = 0;
+
+  // The LRU stack starts out as way 0 most recent, way ways - 1 least
+  if (r->Policy == POLICY_LRU && ways <= LRU_STACK_WAYS)
+    set[0] = 0xfedcba9876543210ULL;
+}
+
+/* Moves way to the top of an LRU stack. */
+static inline uint64_t promoteStack(uint64_t stack, uint32_t way) {
+
+  /*
+  The nibble holding way is the lowest zero nibble of stack ^ way * 1s.
+  The ways above it in the stack keep their place and the ones below
+  it move down one nibble.
+  */
+  uint64_t x = stack ^ (way * NIBBLES_1);
+  uint32_t shift = __builtin_ctzll((x - NIBBLES_1) & ~x & NIBBLES_8) & ~3u;
+  uint64_t below = shift ? stack & ((1ULL << shift) - 1) : 0;
+  uint64_t above = shift + 4 < 64 ? stack & ~((1ULL << (shift + 4)) - 1) : 0;
+
+  return above | below << 4 | way;
+}
+
+/* Marks way as the most recently used one of a tree-PLRU set. */
+static inline uint64_t promoteTree(uint64_t tree, uint32_t ways, uint32_t way) {
+
+  for (uint32_t node = way + ways; node > 1; node >>= 1) {
+    // Point the parent away from the half we came from
+    if (node & 1)
+      tree &= ~(1ULL << (node >> 1));
+    else
+      tree |= 1ULL << (node >> 1);
+  }
+  return tree;
+}
+
+/* Called on every hit to way. */
+static inline void touchLine(Replacement *r, uint64_t *set, uint32_t ways, uint32_t way) {
+
+  switch (r->Policy) {
+  case POLICY_LRU:
+    if (ways <= LRU_STACK_WAYS)
+      set[0] = promoteStack(set[0], way);
+    else
+      set[way] = ++r->clock;
+    break;
+  case POLICY_PLRU:
+    set[0] = promoteTree(set[0], ways, way);
+    break;
+  case POLICY_NRU:
+    set[0] |= 1ULL << way;
+    if (set[0] == wayMask(ways))
+      set[0] = 1ULL << way;
+    break;
+  case POLICY_SRRIP:
+  case POLICY_BRRIP:
+    set[0] &= ~(1ULL << way);
+    set[1] &= ~(1ULL << way);
+    break;
+  }
+}
+
+/*
+Same as count calls to touchLine in a row. Only LRU access stamps
+change with every touch; for every other policy a second touch of the
+same way leaves the set as the first one did.
+*/
+static inline void touchLineRepeatedly(Replacement *r, uint64_t *set, uint32_t ways, uint32_t way,
+                                       uint64_t count) {
+
+  if (r->Policy == POLICY_LRU && ways > LRU_STACK_WAYS) {
+    r->clock += count;
+    set[way] = r->clock;
+  } else if (count > 0)
+    touchLine(r, set, ways, way);
+}
+
+/* Called when a new block is placed in way. */
+static inline void fillLine(Replacement *r, uint64_t *set, uint32_t ways, uint32_t way) {
+
+  switch (r->Policy) {
+  case POLICY_SRRIP:
+    set[0] &= ~(1ULL << way);
+    set[1] |= 1ULL << way;
+    break;
+  case POLICY_BRRIP:
+    if (nextRandom(r) % BRRIP_LONG_ODDS == 0)
+      set[0] &= ~(1ULL << way);
+    else
+      set[0] |= 1ULL << way;
+    set[1] |= 1ULL << way;
+    break;
+  default:
+    touchLine(r, set, ways, way);
+  }
+}
+
+/*
+Whether a set is in a state the operations above can leave it in, as
+far as victimLine goes: an LRU stack holds every way once and NRU never
+has every bit set. Other odd states still give a victim in range.
+*/
+static inline int validSet(const Replacement *r, const uint64_t *set, uint32_t ways) {
+
+  uint32_t seen = 0;
+
+  switch (r->Policy) {
+  case POLICY_LRU:
+    if (ways > LRU_STACK_WAYS)
+      return 1;
+    for (uint32_t w = 0; w < ways; w++)
+      seen |= 1u << ((set[0] >> (4 * w)) & 0xf);
+    return seen == (1u << ways) - 1;
+  case POLICY_NRU:
+    return ways == 1 || (set[0] & wayMask(ways)) != wayMask(ways);
+  default:
+    return 1;
+  }
+}
+
+/* Picks the way to evict from a set whose lines are all valid. */
+static inline uint32_t victimLine(Replacement *r, uint64_t *set, uint32_t ways) {
+
+  uint32_t victim, node;
+  uint64_t full = wayMask(ways), distant;
+
+  if (ways == 1)
+    return 0;
+
+  switch (r->Policy) {
+  case POLICY_LRU:
+    if (ways <= LRU_STACK_WAYS)
+      return (set[0] >> (4 * (ways - 1))) & 0xf;
+    victim = 0;
+    for (uint32_t way = 1; way < ways; way++) {
+      if (set[way] < set[victim])
+        victim = way;
+    }
+    return victim;
+  case POLICY_PLRU:
+    for (node = 1; node < ways;)
+      node = 2 * node + ((set[0] >> node) & 1);
+    return node - ways;
+  case POLICY_NRU:
+    return __builtin_ctzll(~set[0] & full);
+  case POLICY_SRRIP:
+  case POLICY_BRRIP:
+    /*
+    Ageing adds one to every prediction. No way predicts 3 here, so
+    nothing overflows: 0 -> 1 -> 2 -> 3 is low' = ~low and
+    high' = high | low on the bit planes. Three rounds always suffice.
+    */
+    while ((distant = set[0] & set[1] & full) == 0) {
+      set[1] = (set[1] | set[0]) & full;
+      set[0] = ~set[0] & full;
+    }
+    return __builtin_ctzll(distant);
+  default:
+    return (uint32_t)(nextRandom(r) >> 32) & (ways - 1);
+  }
+}
+
+#endif
@@ -0,0 +1,391 @@
+#include "Replay.h"
+
+#include <errno.h>
+#include <math.h>
+
+/*
+Records of a binary trace are walked in place - no parsing, no
+allocation - and those of a packed trace decoded DECODE_SIZE at a time,
+so neither is ever held in memory as a whole. Either way they are
+handed to the simulator in batches of BATCH_SIZE accesses.
+*/
+
+#define BATCH_SIZE 1024
+
+typedef struct Batch {
+  uint64_t addresses[BATCH_SIZE];
+  uint32_t words[BATCH_SIZE];
+  uint8_t modes[BATCH_SIZE];
+  uint32_t pending;
+} Batch;
+
+/*
+Queues the word accesses of a record (see recordWords). Words outside
+the simulated memory are rejected by the simulator and counted as
+skipped; a record wrapping past the top of the address space counts as
+a single skipped access. The batch must have room for RECORD_WORDS more.
+*/
+static void queueRecord(Batch *batch, const TraceRecord *record, ReplayResult *result) {
+
+  uint32_t n = recordWords(record, &batch->addresses[batch->pending]);
+
+  if (n == 0) {
+    result->accesses++;
+    result->skipped++;
+    return;
+  }
+
+  for (uint32_t i = batch->pending; i < batch->pending + n; i++) {
+    batch->modes[i] = record->Mode;
+    batch->words[i] = (uint32_t)batch->addresses[i]; // writes store the address itself
+  }
+  batch->pending += n;
+}
+
+static void issueBatch(Simulator *sim, Batch *batch, ReplayResult *result) {
+  result->skipped += accessBatch(sim, batch->addresses, batch->modes,
+                                 (uint8_t *)batch->words, batch->pending);
+  result->accesses += batch->pending;
+  batch->pending = 0;
+}
+
+void openSource(Source *source, const TraceInput *input) {
+
+  source->input = input;
+  if (input->packed) {
+    seekPackedTrace(&input->packedTrace, &source->cursor, 0);
+    source->next = source->decoded;
+    source->left = 0;
+  } else {
+    source->next = input->trace.records;
+    source->left = input->trace.count;
+  }
+}
+
+int openTraceInput(const char *path, TraceInput *input) {
+
+  memset(input, 0, sizeof(*input));
+  if (mapTrace(path, &input->trace) == 0) {
+    input->count = input->trace.count;
+    return 0;
+  }
+  if (errno != EINVAL || openPackedTrace(path, &input->packedTrace) < 0)
+    return -1;
+  input->packed = 1;
+  input->count = input->packedTrace.count;
+  return 0;
+}
+
+int closeTraceInput(TraceInput *input) {
+
+  int ret = input->packed ? closePackedTrace(&input->packedTrace) : unmapTrace(&input->trace);
+
+  input->count = 0;
+  return ret;
+}
+
+void replayTrace(Simulator *sim, const TraceInput *input, ReplayResult *result) {
+
+  Batch batch;
+  Source source;
+
+  batch.pending = 0;
+  result->accesses = 0;
+  result->skipped = 0;
+  openSource(&source, input);
+
+  while (hasRecord(&source)) {
+    if (batch.pending > BATCH_SIZE - RECORD_WORDS)
+      issueBatch(sim, &batch, result);
+    queueRecord(&batch, nextRecord(&source), result);
+  }
+
+  issueBatch(sim, &batch, result);
+}
+
+void replayTraces(Simulator *sim, const TraceInput *inputs, uint32_t count,
+                  ReplayResult *result) {
+
+  Batch batch;
+  Source sources[MAX_CORES];
+
+  batch.pending = 0;
+  result->accesses = 0;
+  result->skipped = 0;
+  for (uint32_t c = 0; c < count; c++)
+    openSource(&sources[c], &inputs[c]);
+
+  /*
+  Each record goes to the core whose clock is furthest behind, so the
+  cores move forward in step and their accesses reach the bus roughly
+  in the order they would on real hardware.
+  The batches are one record long on purpose. Which core goes next
+  depends on how long the last record took, which is only known once
+  it has been simulated, and a miss has no bound on its cost (bus,
+  DRAM, stalls), so queueing a second record of the same core could
+  let it run ahead of the others and change the order of the
+  coherence traffic. Runs to a block within a record are still served
+  together by accessBatch.
+  */
+  for (;;) {
+    uint32_t core = count;
+
+    for (uint32_t c = 0; c < count; c++) {
+      if (hasRecord(&sources[c]) &&
+          (core == count || getCoreTime(sim, c) < getCoreTime(sim, core)))
+        core = c;
+    }
+    if (core == count)
+      break;
+
+    selectCore(sim, core);
+    queueRecord(&batch, nextRecord(&sources[core]), result);
+    issueBatch(sim, &batch, result);
+  }
+}
+
+/*
+Sampled replay. Accesses are issued in batches of one kind, detailed
+or warming, in trace order; a sample unit's counts are the difference
+between the simulator's counters when it opens and when it closes.
+With set groups as the units, accesses go one at a time so that each
+one's counts can go to its group.
+*/
+
+typedef struct Tally {
+  uint64_t accesses; // simulated in detail
+  uint64_t l1Misses;
+  uint64_t l2Accesses;
+  uint64_t l2Misses;
+  uint64_t cycles;
+} Tally;
+
+/* Sums over the units of x, a, x * x, a * a and x * a, for estimating x / a. */
+typedef struct RatioSums {
+  double x, a, xx, aa, xa;
+} RatioSums;
+
+typedef struct Sampler {
+  Simulator *sim;
+  SampleResult *result;
+  Batch batch;
+  uint32_t warming; // whether the accesses in batch only warm the caches
+  Tally start;      // counters when the open unit opened
+  Tally groups[MAX_SAMPLE_GROUPS];
+  RatioSums l1, l2, cycles;
+} Sampler;
+
+static void readTally(Sampler *s, Tally *t) {
+
+  const Stats *stats = &s->sim->stats;
+
+  t->accesses = s->result->detailed;
+  t->l1Misses = stats->l1.ReadMisses + stats->l1.WriteMisses;
+  t->l2Accesses = stats->l2.Reads + stats->l2.Writes;
+  t->l2Misses = stats->l2.ReadMisses + stats->l2.WriteMisses;
+  t->cycles = s->sim->time;
+}
+
+static void addRatio(RatioSums *r, double x, double a) {
+  r->x += x;
+  r->a += a;
+  r->xx += x * x;
+  r->aa += a * a;
+  r->xa += x * a;
+}
+
+static void addUnit(Sampler *s, const Tally *t) {
+  addRatio(&s->l1, (double)t->l1Misses, (double)t->accesses);
+  addRatio(&s->l2, (double)t->l2Misses, (double)t->l2Accesses);
+  addRatio(&s->cycles, (double)t->cycles, (double)t->accesses);
+  s->result->units++;
+}
+
+/* Closes the open unit, whose counts are those since s->start. */
+static void closeUnit(Sampler *s) {
+
+  Tally end, t;
+
+  readTally(s, &end);
+  t.accesses = end.accesses - s->start.accesses;
+  t.l1Misses = end.l1Misses - s->start.l1Misses;
+  t.l2Accesses = end.l2Accesses - s->start.l2Accesses;
+  t.l2Misses = end.l2Misses - s->start.l2Misses;
+  t.cycles = end.cycles - s->start.cycles;
+  addUnit(s, &t);
+}
+
+/*
+The ratio estimator of x / a over n units, a fraction of all there are,
+with the usual first-order approximation of its variance.
+*/
+static Estimate ratioEstimate(const RatioSums *r, uint64_t n, double fraction) {
+
+  Estimate e = {NAN, NAN};
+  double squares;
+
+  if (r->a <= 0)
+    return e;
+  e.Value = r->x / r->a;
+  if (n < 2)
+    return e;
+
+  // The sum of (x - Value * a)^2 over the units
+  squares = r->xx - 2 * e.Value * r->xa + e.Value * e.Value * r->aa;
+  if (squares < 0)
+    squares = 0;
+  e.Error = 1.96 * sqrt((1 - fraction) * squares / (double)(n - 1) / (double)n) /
+            (r->a / (double)n);
+  return e;
+}
+
+static void issueSampled(Sampler *s) {
+
+  Batch *b = &s->batch;
+  uint32_t rejected;
+
+  if (b->pending == 0)
+    return;
+  if (s->warming) {
+    rejected = warmBatch(s->sim, b->addresses, b->modes, b->pending);
+    s->result->warmed += b->pending - rejected;
+  } else {
+    rejected = accessBatch(s->sim, b->addresses, b->modes, NULL, b->pending);
+    s->result->detailed += b->pending - rejected;
+  }
+  s->result->skipped += rejected;
+  b->pending = 0;
+}
+
+/*
+Set sampling picks sets by the index bits the two levels have in
+common, counted in blocks of the larger size, so that each set of
+either level gets all of its blocks simulated or none of them. Those
+bits are hashed rather than used as they are, so that strides don't
+favour some groups of sets over others. Returns how many bits there
+are, which is 0 or less when the larger block spans a whole set of
+the other level (a fully associative L1, say).
+*/
+static int32_t indexBits(Simulator *sim, uint32_t *blockBits) {
+
+  const CacheGeometry *l1 = &sim->core->l1_cache.geometry, *l2 = &sim->l2_cache.geometry;
+  int32_t l1Bits = __builtin_ctz(l1->Size / l1->Ways), l2Bits = __builtin_ctz(l2->Size / l2->Ways);
+
+  *blockBits = __builtin_ctz(l1->BlockSize > l2->BlockSize ? l1->BlockSize : l2->BlockSize);
+  return (l1Bits < l2Bits ? l1Bits : l2Bits) - (int32_t)*blockBits;
+}
+
+/* The splitmix64 finalizer: every bit of x affects every bit of the result. */
+static inline uint64_t mixBits(uint64_t x) {
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* Simulates one access in detail, adding its counts to its group. */
+static void sampleAccess(Sampler *s, uint64_t address, uint8_t mode, uint32_t group) {
+
+  Tally *g = &s->groups[group];
+  Tally before, after;
+
+  readTally(s, &before);
+  s->batch.addresses[0] = address;
+  s->batch.modes[0] = mode;
+  s->batch.pending = 1;
+  s->warming = 0;
+  issueSampled(s);
+  readTally(s, &after);
+
+  g->accesses += after.accesses - before.accesses;
+  g->l1Misses += after.l1Misses - before.l1Misses;
+  g->l2Accesses += after.l2Accesses - before.l2Accesses;
+  g->l2Misses += after.l2Misses - before.l2Misses;
+  g->cycles += after.cycles - before.cycles;
+}
+
+int sampleTrace(Simulator *sim, const TraceInput *input, const SamplingConfig *config,
+                SampleResult *result) {
+
+  Sampler sampler = {0}, *s = &sampler;
+  Source source;
+  const TraceRecord *next;
+  uint64_t words[RECORD_WORDS];
+  uint32_t windows = config->Window > 0, perAccess = !windows && config->Groups > 1;
+  uint32_t inUnit = !windows && !perAccess; // a single unit covers the whole run
+  uint32_t blockBits, n;
+  int32_t setBits;
+  uint64_t record = 0;
+  double fraction;
+
+  setBits = indexBits(sim, &blockBits);
+  if (!sim->timing_only || sim->core_count != 1 || setBits <= 0 || config->SetRatio == 0 ||
+      config->Groups == 0 || config->Groups > MAX_SAMPLE_GROUPS ||
+      (windows && config->Period < config->Window))
+    return -1;
+
+  memset(result, 0, sizeof(*result));
+  s->sim = sim;
+  s->result = result;
+  openSource(&source, input);
+  if (inUnit)
+    readTally(s, &s->start);
+
+  while (hasRecord(&source)) {
+    uint32_t detailed = !windows || record % config->Period < config->Window;
+
+    record++;
+    if (windows && detailed != inUnit) {
+      issueSampled(s);
+      if (detailed)
+        readTally(s, &s->start);
+      else
+        closeUnit(s);
+      inUnit = detailed;
+    }
+
+    // A record wrapping past the top of the address space is skipped, as in replayTrace
+    next = nextRecord(&source);
+    n = recordWords(next, words);
+    if (n == 0) {
+      result->accesses++;
+      result->skipped++;
+      continue;
+    }
+
+    for (uint32_t i = 0; i < n; i++) {
+      uint64_t hash = mixBits((words[i] >> blockBits) & ((1ULL << setBits) - 1));
+      uint32_t group = (uint32_t)(hash / config->SetRatio % config->Groups);
+
+      result->accesses++;
+      if (hash % config->SetRatio != 0)
+        continue;
+      if (perAccess) {
+        sampleAccess(s, words[i], next->Mode, group);
+        continue;
+      }
+      if (s->batch.pending == BATCH_SIZE || s->warming == detailed)
+        issueSampled(s);
+      s->warming = !detailed;
+      s->batch.addresses[s->batch.pending] = words[i];
+      s->batch.modes[s->batch.pending] = next->Mode;
+      s->batch.pending++;
+    }
+  }
+
+  issueSampled(s);
+  if (inUnit)
+    closeUnit(s);
+  for (uint32_t g = 0; perAccess && g < config->Groups; g++)
+    addUnit(s, &s->groups[g]);
+
+  fraction = windows ? (double)config->Window / (double)config->Period
+                     : 1.0 / (double)config->SetRatio;
+  result->l1MissRate = ratioEstimate(&s->l1, result->units, fraction);
+  result->l2MissRate = ratioEstimate(&s->l2, result->units, fraction);
+  result->cyclesPerAccess = ratioEstimate(&s->cycles, result->units, fraction);
+  result->time.Value = result->cyclesPerAccess.Value * (double)result->accesses;
+  result->time.Error = result->cyclesPerAccess.Error * (double)result->accesses;
+
+  return 0;
+}
@@ -0,0 +1,161 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "L2_2WCache.h"
+#include "PackedTrace.h"
+#include "Trace.h"
+
+#define RECORD_WORDS (255 / WORD_SIZE + 2) // most words one record can touch
+
+/*
+The caches move one word at a time, so a record is aligned down to a
+word and becomes one access per word it touches. Stores their addresses
+in addresses (room for RECORD_WORDS) and returns how many there are, or
+0 for a record wrapping past the top of the address space.
+*/
+static inline uint32_t recordWords(const TraceRecord *record, uint64_t *addresses) {
+
+  uint32_t width = record->Width ? record->Width : WORD_SIZE, n = 0;
+  uint64_t first = record->Address & ~(uint64_t)(WORD_SIZE - 1);
+  uint64_t last = (record->Address + width - 1) & ~(uint64_t)(WORD_SIZE - 1);
+
+  if (last < first)
+    return 0;
+  for (uint64_t address = first;; address += WORD_SIZE) {
+    addresses[n++] = address;
+    if (address == last)
+      return n;
+  }
+}
+
+typedef struct ReplayResult {
+  uint64_t accesses; // word accesses issued to the simulator
+  uint64_t skipped;  // of which outside the simulated memory
+} ReplayResult;
+
+/*
+A trace in either format: a mapped binary trace, walked in place, or
+a packed one, decoded a few records at a time as the replay goes.
+*/
+typedef struct TraceInput {
+  uint32_t packed; // which of the two below is open
+  Trace trace;
+  PackedTrace packedTrace;
+  uint64_t count;  // records
+} TraceInput;
+
+/*
+Opens a trace file of either format, telling them apart by their magic
+number. Both return 0 on success and -1 (with errno set) on failure.
+*/
+int openTraceInput(const char *, TraceInput *);
+int closeTraceInput(TraceInput *);
+
+#define DECODE_SIZE 256 // records of a packed trace decoded at a time
+
+/*
+Where a walk over a trace has got to, for reading its records in
+order whatever the format. Records are taken from next until left runs
+out; a binary trace is a single run of them, a packed one is refilled
+into decoded whenever it does. The trace is only read, so it can be
+walked by many sources at the same time.
+*/
+typedef struct Source {
+  const TraceInput *input;
+  PackedCursor cursor;
+  const TraceRecord *next;
+  uint64_t left;
+  TraceRecord decoded[DECODE_SIZE];
+} Source;
+
+/* Starts a source at the first record of a trace. */
+void openSource(Source *, const TraceInput *);
+
+/* Returns whether the source has another record, decoding more if need be. */
+static inline int hasRecord(Source *source) {
+
+  if (source->left == 0 && source->input->packed) {
+    source->left = decodePackedTrace(&source->input->packedTrace, &source->cursor,
+                                     source->decoded, DECODE_SIZE);
+    source->next = source->decoded;
+  }
+  return source->left != 0;
+}
+
+static inline const TraceRecord *nextRecord(Source *source) {
+  source->left--;
+  return source->next++;
+}
+
+/*
+Streams every record of a trace through the simulator. The trace is
+only read, so one trace can be replayed by many simulators at the same
+time.
+*/
+void replayTrace(Simulator *, const TraceInput *, ReplayResult *);
+
+/*
+Replays one trace per core on a simulator set up with setCores(count),
+always advancing the core whose clock is furthest behind. Results are
+summed over all the traces.
+*/
+void replayTraces(Simulator *, const TraceInput *, uint32_t count, ReplayResult *);
+
+/*
+Sampled replay, which estimates what replayTrace would measure at a
+fraction of its cost:
+
+  Set sampling       only one set in SetRatio is simulated, chosen by
+                     a hash of the set index bits the two levels have
+                     in common; accesses to the other sets are left
+                     out. The sampled sets are split by the hash into
+                     Groups groups. A SetRatio of 1 turns it off.
+  Interval sampling  only the first Window records of every Period are
+                     simulated in detail; the rest only warm the caches
+                     (see warmBatch). A Window of 0 turns it off.
+
+The estimates are ratios over sample units - the windows if there are
+any, otherwise the set groups - with 95% confidence intervals from the
+spread between units. With windows, the intervals leave out the error
+from sampling sets.
+
+Set sampling hides most of the access stream from the prefetchers, so
+a stride or stream prefetcher sees other strides than the full trace
+would give it, and its estimates are biased; interval sampling keeps
+the stream whole.
+
+Sampling only makes sense for timing, so the simulator must be
+timing-only, and it has to have a single core. Its two levels need
+set index bits in common, which they lack when the larger block spans
+a whole set of the other level.
+*/
+typedef struct SamplingConfig {
+  uint32_t SetRatio;
+  uint32_t Groups; // at most MAX_SAMPLE_GROUPS
+  uint64_t Window;
+  uint64_t Period;
+} SamplingConfig;
+
+#define MAX_SAMPLE_GROUPS 64
+
+typedef struct Estimate {
+  double Value;
+  double Error; // half width of the 95% confidence interval, NAN with fewer than two units
+} Estimate;
+
+typedef struct SampleResult {
+  uint64_t accesses; // word accesses in the trace
+  uint64_t skipped;  // of which outside the simulated memory
+  uint64_t detailed; // of which simulated in detail
+  uint64_t warmed;   // of which only warmed
+  uint64_t units;
+  Estimate l1MissRate; // misses per L1 access
+  Estimate l2MissRate; // misses per L2 access
+  Estimate cyclesPerAccess;
+  Estimate time;       // cyclesPerAccess over every access of the trace
+} SampleResult;
+
+/* Returns -1 if the configuration or the simulator doesn't allow sampling. */
+int sampleTrace(Simulator *, const TraceInput *, const SamplingConfig *, SampleResult *);
+
+#endif
@@ -0,0 +1,81 @@
+#include "Replay.h"
+#include "StackDistance.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Companion to TraceReplay: instead of simulating one hierarchy, this
+makes a single pass over a trace (binary or packed) and prints the LRU miss ratio of every
+power-of-two cache with up to MaxSets sets and MaxWays ways at the
+given block size. Records are split into word accesses the way the
+replay splits them (see recordWords), so the accesses and miss ratios
+are counted as TraceReplay counts them.
+*/
+
+static int usage(const char *name) {
+  fprintf(stderr, "Usage: %s <trace file> [-b block size] [-s max sets] [-w max ways]\n", name);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  TraceInput trace;
+  Source source;
+  StackDistance sd;
+  uint64_t words[RECORD_WORDS];
+  uint32_t blockSize = 64, maxSets = 1024, maxWays = 16;
+
+  if (argc < 2 || argc % 2 != 0)
+    return usage(argv[0]);
+
+  for (int i = 2; i < argc; i += 2) {
+    uint32_t value = (uint32_t)strtoul(argv[i + 1], NULL, 0);
+    if (strcmp(argv[i], "-b") == 0)
+      blockSize = value;
+    else if (strcmp(argv[i], "-s") == 0)
+      maxSets = value;
+    else if (strcmp(argv[i], "-w") == 0)
+      maxWays = value;
+    else
+      return usage(argv[0]);
+  }
+
+  if (initStackDistance(&sd, blockSize, maxSets, maxWays) < 0) {
+    fprintf(stderr, "Block size, sets and ways must be powers of two\n");
+    return 1;
+  }
+
+  if (openTraceInput(argv[1], &trace) < 0) {
+    fprintf(stderr, "Could not open trace %s: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+
+  openSource(&source, &trace);
+  while (hasRecord(&source)) {
+    uint32_t n = recordWords(nextRecord(&source), words);
+
+    for (uint32_t w = 0; w < n; w++)
+      stackDistanceAccess(&sd, words[w]);
+  }
+
+  printf("Block size: %u\n", blockSize);
+  printf("Accesses: %llu\n", (unsigned long long)sd.accesses);
+  printf("Distinct blocks: %u\n", sd.blocks);
+  printf("\nSets; Ways; Size; Misses; Miss ratio\n");
+
+  for (uint32_t sets = 1; sets <= maxSets; sets *= 2) {
+    for (uint32_t ways = 1; ways <= maxWays; ways *= 2) {
+      uint64_t misses = stackDistanceMisses(&sd, sets, ways);
+      printf("%u; %u; %llu; %llu; %.6f\n", sets, ways,
+             (unsigned long long)sets * ways * blockSize, (unsigned long long)misses,
+             sd.accesses ? (double)misses / (double)sd.accesses : 0.0);
+    }
+  }
+
+  freeStackDistance(&sd);
+  closeTraceInput(&trace);
+  return 0;
+}
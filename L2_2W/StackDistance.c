@@ -0,0 +1,277 @@
+#include "StackDistance.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define EMPTY_KEY UINT64_MAX // never a block number, blocks are >= 4 bytes
+#define INITIAL_BLOCKS 1024
+
+static int isPowerOfTwo(uint32_t x) { return x != 0 && (x & (x - 1)) == 0; }
+
+/* Murmur3 finalizer, used both for hashing and for treap priorities. */
+static uint32_t mix(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x85ebca6b;
+  x ^= x >> 13;
+  x *= 0xc2b2ae35;
+  x ^= x >> 16;
+  return x;
+}
+
+static uint32_t hashBlock(uint64_t block) { return mix((uint32_t)(block ^ (block >> 32))); }
+
+static void *growArray(void *array, size_t count, size_t size) {
+
+  array = realloc(array, count * size);
+  if (array == NULL)
+    exit(-1);
+  return array;
+}
+
+/*********************** Treap *************************/
+
+/*
+Node 0 is the empty tree, so size[0] stays 0 and ids start at 1. The
+keys (last access times) are shared by all set counts and live in
+StackDistance.times; they're unique because time advances every access.
+*/
+
+static void updateSize(StackLevel *lv, uint32_t node) {
+  lv->size[node] = 1 + lv->size[lv->left[node]] + lv->size[lv->right[node]];
+}
+
+/* Joins two treaps where every key in a is smaller than every key in b. */
+static uint32_t merge(StackLevel *lv, uint32_t a, uint32_t b) {
+
+  if (a == 0)
+    return b;
+  if (b == 0)
+    return a;
+
+  if (mix(a) > mix(b)) {
+    lv->right[a] = merge(lv, lv->right[a], b);
+    updateSize(lv, a);
+    return a;
+  }
+
+  lv->left[b] = merge(lv, a, lv->left[b]);
+  updateSize(lv, b);
+  return b;
+}
+
+/* Removes node (whose key is time) from the treap rooted at root. */
+static uint32_t erase(StackLevel *lv, const uint64_t *times, uint32_t root,
+                      uint32_t node, uint64_t time) {
+
+  if (root == node)
+    return merge(lv, lv->left[node], lv->right[node]);
+
+  if (time < times[root])
+    lv->left[root] = erase(lv, times, lv->left[root], node, time);
+  else
+    lv->right[root] = erase(lv, times, lv->right[root], node, time);
+
+  lv->size[root]--;
+  return root;
+}
+
+/* Number of nodes accessed after time, i.e. the stack distance. */
+static uint32_t countLater(const StackLevel *lv, const uint64_t *times, uint32_t root,
+                           uint64_t time) {
+
+  uint32_t count = 0;
+
+  while (root != 0) {
+    if (times[root] > time) {
+      count += 1 + lv->size[lv->right[root]];
+      root = lv->left[root];
+    } else {
+      root = lv->right[root];
+    }
+  }
+  return count;
+}
+
+/*********************** Block ids *************************/
+
+static void growBlocks(StackDistance *sd) {
+
+  uint32_t capacity = sd->capacity * 2;
+
+  sd->times = growArray(sd->times, capacity + 1, sizeof(uint64_t));
+  for (uint32_t l = 0; l < sd->Levels; l++) {
+    StackLevel *lv = &sd->levels[l];
+    lv->left = growArray(lv->left, capacity + 1, sizeof(uint32_t));
+    lv->right = growArray(lv->right, capacity + 1, sizeof(uint32_t));
+    lv->size = growArray(lv->size, capacity + 1, sizeof(uint32_t));
+  }
+  sd->capacity = capacity;
+}
+
+static void growHash(StackDistance *sd) {
+
+  uint32_t oldSize = sd->hashSize, *oldIds = sd->hashIds;
+  uint64_t *oldKeys = sd->hashKeys;
+
+  sd->hashSize = oldSize * 2;
+  sd->hashKeys = growArray(NULL, sd->hashSize, sizeof(uint64_t));
+  sd->hashIds = growArray(NULL, sd->hashSize, sizeof(uint32_t));
+  memset(sd->hashKeys, 0xff, sd->hashSize * sizeof(uint64_t));
+
+  for (uint32_t i = 0; i < oldSize; i++) {
+    if (oldKeys[i] == EMPTY_KEY)
+      continue;
+    uint32_t slot = hashBlock(oldKeys[i]) & (sd->hashSize - 1);
+    while (sd->hashKeys[slot] != EMPTY_KEY)
+      slot = (slot + 1) & (sd->hashSize - 1);
+    sd->hashKeys[slot] = oldKeys[i];
+    sd->hashIds[slot] = oldIds[i];
+  }
+
+  free(oldKeys);
+  free(oldIds);
+}
+
+/* Returns the id of block, or 0 after giving it a new id (first touch). */
+static uint32_t findBlock(StackDistance *sd, uint64_t block, uint32_t *id) {
+
+  uint32_t slot = hashBlock(block) & (sd->hashSize - 1);
+
+  while (sd->hashKeys[slot] != EMPTY_KEY) {
+    if (sd->hashKeys[slot] == block) {
+      *id = sd->hashIds[slot];
+      return *id;
+    }
+    slot = (slot + 1) & (sd->hashSize - 1);
+  }
+
+  if (sd->blocks == sd->capacity)
+    growBlocks(sd);
+
+  *id = ++sd->blocks;
+  sd->hashKeys[slot] = block;
+  sd->hashIds[slot] = *id;
+
+  // Keep the table at most half full
+  if (sd->blocks * 2 > sd->hashSize)
+    growHash(sd);
+  return 0;
+}
+
+/*********************** Interface *************************/
+
+int initStackDistance(StackDistance *sd, uint32_t blockSize, uint32_t maxSets, uint32_t maxWays) {
+
+  if (!isPowerOfTwo(blockSize) || !isPowerOfTwo(maxSets) || !isPowerOfTwo(maxWays) ||
+      blockSize < 4)
+    return -1;
+
+  memset(sd, 0, sizeof(*sd));
+  sd->BlockBits = __builtin_ctz(blockSize);
+  sd->Levels = __builtin_ctz(maxSets) + 1;
+  sd->MaxWays = maxWays;
+
+  /*
+  growBlocks doubles the capacity, so we start from half and let it
+  allocate the per-block arrays of every level.
+  */
+  sd->levels = growArray(NULL, sd->Levels, sizeof(StackLevel));
+  memset(sd->levels, 0, sd->Levels * sizeof(StackLevel));
+  sd->capacity = INITIAL_BLOCKS / 2;
+  growBlocks(sd);
+
+  for (uint32_t l = 0; l < sd->Levels; l++) {
+    StackLevel *lv = &sd->levels[l];
+    lv->roots = growArray(NULL, 1u << l, sizeof(uint32_t));
+    lv->mru = growArray(NULL, 1u << l, sizeof(uint32_t));
+    lv->histogram = growArray(NULL, maxWays + 1, sizeof(uint64_t));
+    memset(lv->roots, 0, (1u << l) * sizeof(uint32_t));
+    memset(lv->mru, 0, (1u << l) * sizeof(uint32_t));
+    memset(lv->histogram, 0, (maxWays + 1) * sizeof(uint64_t));
+    lv->left[0] = lv->right[0] = lv->size[0] = 0;
+  }
+
+  sd->hashSize = INITIAL_BLOCKS;
+  sd->hashKeys = growArray(NULL, sd->hashSize, sizeof(uint64_t));
+  sd->hashIds = growArray(NULL, sd->hashSize, sizeof(uint32_t));
+  memset(sd->hashKeys, 0xff, sd->hashSize * sizeof(uint64_t));
+  return 0;
+}
+
+void freeStackDistance(StackDistance *sd) {
+
+  for (uint32_t l = 0; l < sd->Levels; l++) {
+    StackLevel *lv = &sd->levels[l];
+    free(lv->roots);
+    free(lv->mru);
+    free(lv->left);
+    free(lv->right);
+    free(lv->size);
+    free(lv->histogram);
+  }
+  free(sd->levels);
+  free(sd->times);
+  free(sd->hashKeys);
+  free(sd->hashIds);
+  memset(sd, 0, sizeof(*sd));
+}
+
+void stackDistanceAccess(StackDistance *sd, uint64_t address) {
+
+  uint64_t block = address >> sd->BlockBits;
+  uint32_t id, set, distance, seen;
+  uint64_t now = ++sd->accesses;
+
+  seen = findBlock(sd, block, &id) != 0;
+  if (!seen)
+    sd->cold++;
+
+  for (uint32_t l = 0; l < sd->Levels; l++) {
+    StackLevel *lv = &sd->levels[l];
+    set = (uint32_t)block & ((1u << l) - 1);
+
+    /*
+    Re-touching the most recent block of a set (the common case for
+    sequential sweeps) is distance 0 and leaves the treap as it is:
+    the block keeps the largest key of its set.
+    */
+    if (seen && lv->mru[set] == id) {
+      lv->histogram[0]++;
+      continue;
+    }
+
+    /*
+    A block we've seen before is taken out of its set's treap, after
+    counting how many blocks of the set were touched since.
+    */
+    if (seen) {
+      distance = countLater(lv, sd->times, lv->roots[set], sd->times[id]);
+      lv->histogram[distance < sd->MaxWays ? distance : sd->MaxWays]++;
+      lv->roots[set] = erase(lv, sd->times, lv->roots[set], id, sd->times[id]);
+    }
+
+    // It goes back in as the most recently used block of its set
+    lv->left[id] = 0;
+    lv->right[id] = 0;
+    lv->size[id] = 1;
+    lv->roots[set] = merge(lv, lv->roots[set], id);
+    lv->mru[set] = id;
+  }
+
+  sd->times[id] = now;
+}
+
+uint64_t stackDistanceMisses(const StackDistance *sd, uint32_t sets, uint32_t ways) {
+
+  uint64_t misses = sd->cold;
+  const StackLevel *lv;
+
+  if (!isPowerOfTwo(sets) || !isPowerOfTwo(ways) || ways > sd->MaxWays ||
+      (uint32_t)__builtin_ctz(sets) >= sd->Levels)
+    return 0;
+
+  lv = &sd->levels[__builtin_ctz(sets)];
+  for (uint32_t d = ways; d <= sd->MaxWays; d++)
+    misses += lv->histogram[d];
+  return misses;
+}
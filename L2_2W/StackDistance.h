@@ -0,0 +1,63 @@
+#ifndef STACKDISTANCE_H
+#define STACKDISTANCE_H
+
+#include <stdint.h>
+
+/*
+Mattson stack-distance simulation. For LRU, a block's stack distance
+is the number of distinct blocks of its set touched since its previous
+access, and an access hits in a W-way cache exactly when that distance
+is below W. So one pass that records the distance histogram for a
+given number of sets yields the miss count of every associativity with
+that many sets.
+
+We keep one such histogram for every power-of-two set count from 1 to
+MaxSets at once, giving miss ratios for every capacity (sets * ways *
+block size) in a single pass over a trace.
+
+Per set count, the blocks of each set are kept in a treap ordered by
+the time of their last access, so the distance of an access is the
+number of nodes with a later time: O(log n) per set count.
+*/
+
+typedef struct StackLevel {
+  uint32_t *roots;      // treap root per set, 0 if empty
+  uint32_t *mru;        // most recently used block per set
+  uint32_t *left;       // per block
+  uint32_t *right;      // per block
+  uint32_t *size;       // per block, nodes in the subtree
+  uint64_t *histogram;  // distances 0..MaxWays-1, MaxWays for longer
+} StackLevel;
+
+typedef struct StackDistance {
+  uint32_t BlockBits;
+  uint32_t Levels;      // set counts 1, 2, 4, ..., 2^(Levels-1)
+  uint32_t MaxWays;
+  uint64_t accesses;
+  uint64_t cold;        // first touches, a miss for every configuration
+  uint32_t blocks;      // distinct blocks seen, ids are 1..blocks
+  uint32_t capacity;    // ids allocated
+  uint64_t *times;      // per block, time of its last access
+  uint64_t *hashKeys;   // block number -> id, open addressing
+  uint32_t *hashIds;
+  uint32_t hashSize;
+  StackLevel *levels;
+} StackDistance;
+
+/*
+Block size, MaxSets and MaxWays must be powers of two. Returns 0 on
+success and -1 on invalid arguments.
+*/
+int initStackDistance(StackDistance *, uint32_t, uint32_t, uint32_t);
+
+void freeStackDistance(StackDistance *);
+
+void stackDistanceAccess(StackDistance *, uint64_t);
+
+/*
+LRU misses of a cache with the given sets and ways (both powers of two,
+at most MaxSets and MaxWays) over all accesses seen so far.
+*/
+uint64_t stackDistanceMisses(const StackDistance *, uint32_t, uint32_t);
+
+#endif
@@ -0,0 +1,253 @@
+#include "Replay.h"
+#include "ThreadPool.h"
+
+#include <errno.h>
+#include <time.h>
+
+/*
+Runs many hierarchy configurations over the same trace in parallel.
+The trace, binary or packed, is opened once and shared read-only (each
+replay of a packed trace decodes it on its own); every configuration gets
+its own Simulator, and the configurations are spread over a
+work-stealing thread pool (see ThreadPool.h). Results are written as a
+single table, in the order the configurations were given.
+
+Configurations come from a file with one per line:
+
+  l1_size l1_block l1_ways l2_size l2_block l2_ways [l1_read l1_write
+  l2_read l2_write dram_read dram_write [mshrs [victims]]]
+
+Latencies left out keep their Cache.h values, L1 is blocking unless
+a number of MSHRs is given and has no victim cache unless a number of
+entries is given; lines starting with # are ignored. Without a file
+we sweep a built-in grid of sizes and ways. Both levels use LRU unless
+another replacement policy is given with -p, and the hierarchy is
+neither inclusive nor exclusive unless -i says otherwise.
+*/
+
+typedef struct SweepConfig {
+  CacheGeometry l1;
+  CacheGeometry l2;
+  Latencies latency;
+  uint32_t mshrs;
+  uint32_t victims; // victim cache entries
+  uint32_t inclusion;
+} SweepConfig;
+
+typedef struct SweepResult {
+  uint64_t time;
+  uint32_t valid;
+  ReplayResult replay;
+  double seconds;
+} SweepResult;
+
+typedef struct Sweep {
+  const TraceInput *trace;
+  const SweepConfig *configs;
+  SweepResult *results;
+  uint32_t timingOnly;
+} Sweep;
+
+static const Latencies defaultLatency = {L1_READ_TIME, L1_WRITE_TIME, L2_READ_TIME,
+                                         L2_WRITE_TIME, DRAM_READ_TIME, DRAM_WRITE_TIME,
+                                         SNOOP_TIME, VICTIM_TIME};
+
+static int usage(const char *name) {
+  fprintf(stderr, "Usage: %s <trace file> [-c config file] [-j threads] [-o output] [-p policy] "
+                  "[-i inclusion] [-d]\n",
+          name);
+  return 1;
+}
+
+static double elapsedSeconds(struct timespec *start, struct timespec *end) {
+  return (double)(end->tv_sec - start->tv_sec) +
+         (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* Appends a configuration, growing the array as needed. */
+static void addConfig(SweepConfig **configs, uint32_t *count, const SweepConfig *config) {
+
+  if ((*count & (*count - 1)) == 0) { // count is 0 or a power of two
+    *configs = realloc(*configs, (*count ? *count * 2 : 16) * sizeof(SweepConfig));
+    if (*configs == NULL)
+      exit(-1);
+  }
+  (*configs)[(*count)++] = *config;
+}
+
+static int readConfigs(const char *path, SweepConfig **configs, uint32_t *count) {
+
+  char line[512];
+  FILE *file = fopen(path, "r");
+
+  if (file == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), file) != NULL) {
+    SweepConfig config = {.latency = defaultLatency};
+    Latencies *t = &config.latency;
+    int fields = sscanf(line, "%u %u %u %u %u %u %u %u %u %u %u %u %u %u",
+                        &config.l1.Size, &config.l1.BlockSize, &config.l1.Ways,
+                        &config.l2.Size, &config.l2.BlockSize, &config.l2.Ways,
+                        &t->L1Read, &t->L1Write, &t->L2Read, &t->L2Write,
+                        &t->DRAMRead, &t->DRAMWrite, &config.mshrs,
+                        &config.victims);
+    if (fields >= 6)
+      addConfig(configs, count, &config);
+    else if (fields > 0)
+      fprintf(stderr, "Ignoring incomplete configuration: %s", line);
+  }
+
+  fclose(file);
+  return 0;
+}
+
+/* Every L1 size and associativity against every L2 size and associativity. */
+static void gridConfigs(SweepConfig **configs, uint32_t *count) {
+
+  for (uint32_t l1Size = 4096; l1Size <= 65536; l1Size *= 2)
+    for (uint32_t l1Ways = 1; l1Ways <= 8; l1Ways *= 2)
+      for (uint32_t l2Size = 32768; l2Size <= 1048576; l2Size *= 2)
+        for (uint32_t l2Ways = 2; l2Ways <= 16; l2Ways *= 2) {
+          SweepConfig config = {{l1Size, BLOCK_SIZE, l1Ways, 0, 0, 0, 0, POLICY_LRU},
+                                {l2Size, BLOCK_SIZE, l2Ways, 0, 0, 0, 0, POLICY_LRU},
+                                defaultLatency, 0, 0, INCLUSION_NINE};
+          addConfig(configs, count, &config);
+        }
+}
+
+static void runConfig(uint32_t task, uint32_t worker, void *arg) {
+
+  Sweep *sweep = arg;
+  const SweepConfig *config = &sweep->configs[task];
+  SweepResult *result = &sweep->results[task];
+  struct timespec start, end;
+  Simulator sim;
+
+  (void)worker;
+
+  initSimulator(&sim);
+  if (configureCaches(&sim, &config->l1, &config->l2) < 0 ||
+      setInclusion(&sim, config->inclusion) < 0 || setMSHRs(&sim, config->mshrs) < 0 ||
+      setVictimCache(&sim, config->victims) < 0) {
+    result->valid = 0;
+    return;
+  }
+  sim.latency = config->latency;
+  setTimingOnly(&sim, sweep->timingOnly);
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  replayTrace(&sim, sweep->trace, &result->replay);
+  waitForMisses(&sim);
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  result->time = getTime(&sim);
+  result->seconds = elapsedSeconds(&start, &end);
+  result->valid = 1;
+  freeSimulator(&sim);
+}
+
+static void writeResults(FILE *out, const Sweep *sweep, uint32_t count) {
+
+  fprintf(out, "L1 size; L1 block; L1 ways; L1 policy; L2 size; L2 block; L2 ways; L2 policy; "
+               "L1 read; L1 write; L2 read; L2 write; DRAM read; DRAM write; MSHRs; "
+               "Victims; Inclusion; Accesses; Time; Seconds\n");
+
+  for (uint32_t i = 0; i < count; i++) {
+    const SweepConfig *c = &sweep->configs[i];
+    const SweepResult *r = &sweep->results[i];
+
+    fprintf(out, "%u; %u; %u; %s; %u; %u; %u; %s; %u; %u; %u; %u; %u; %u; %u; %u; %s; ",
+            c->l1.Size, c->l1.BlockSize, c->l1.Ways, policyName(c->l1.Policy),
+            c->l2.Size, c->l2.BlockSize, c->l2.Ways, policyName(c->l2.Policy),
+            c->latency.L1Read, c->latency.L1Write, c->latency.L2Read, c->latency.L2Write,
+            c->latency.DRAMRead, c->latency.DRAMWrite, c->mshrs, c->victims,
+            inclusionName(c->inclusion));
+    if (r->valid)
+      fprintf(out, "%llu; %llu; %.3f\n", (unsigned long long)r->replay.accesses,
+              (unsigned long long)r->time, r->seconds);
+    else
+      fprintf(out, "invalid; invalid; invalid\n");
+  }
+}
+
+int main(int argc, char **argv) {
+
+  TraceInput trace;
+  Sweep sweep;
+  SweepConfig *configs = NULL;
+  uint32_t count = 0, threads = onlineCpus(), timingOnly = 1;
+  int policy = POLICY_LRU, inclusion = INCLUSION_NINE;
+  const char *configPath = NULL, *outputPath = NULL;
+  struct timespec start, end;
+  FILE *out = stdout;
+
+  if (argc < 2)
+    return usage(argv[0]);
+
+  for (int i = 2; i < argc; i++) {
+    if (strcmp(argv[i], "-d") == 0)
+      timingOnly = 0;
+    else if (i + 1 < argc && strcmp(argv[i], "-c") == 0)
+      configPath = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "-o") == 0)
+      outputPath = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "-j") == 0)
+      threads = (uint32_t)strtoul(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-p") == 0 && (policy = parsePolicy(argv[++i])) >= 0)
+      continue;
+    else if (i + 1 < argc && strcmp(argv[i], "-i") == 0 &&
+             (inclusion = parseInclusion(argv[++i])) >= 0)
+      continue;
+    else
+      return usage(argv[0]);
+  }
+
+  if (configPath != NULL && readConfigs(configPath, &configs, &count) < 0) {
+    fprintf(stderr, "Could not read %s: %s\n", configPath, strerror(errno));
+    return 1;
+  }
+  if (configPath == NULL)
+    gridConfigs(&configs, &count);
+
+  for (uint32_t i = 0; i < count; i++) {
+    configs[i].l1.Policy = (uint32_t)policy;
+    configs[i].l2.Policy = (uint32_t)policy;
+    configs[i].inclusion = (uint32_t)inclusion;
+  }
+
+  if (openTraceInput(argv[1], &trace) < 0) {
+    fprintf(stderr, "Could not open trace %s: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+
+  sweep.trace = &trace;
+  sweep.configs = configs;
+  sweep.results = calloc(count ? count : 1, sizeof(SweepResult));
+  sweep.timingOnly = timingOnly;
+  if (sweep.results == NULL)
+    return 1;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (runPool(count, threads, runConfig, &sweep) < 0) {
+    fprintf(stderr, "Could not start worker threads\n");
+    return 1;
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  if (outputPath != NULL && (out = fopen(outputPath, "w")) == NULL) {
+    fprintf(stderr, "Could not open %s: %s\n", outputPath, strerror(errno));
+    return 1;
+  }
+  writeResults(out, &sweep, count);
+  if (out != stdout)
+    fclose(out);
+
+  fprintf(stderr, "%u configurations on %u threads in %.3f s\n", count, threads,
+          elapsedSeconds(&start, &end));
+
+  free(sweep.results);
+  free(configs);
+  closeTraceInput(&trace);
+  return 0;
+}
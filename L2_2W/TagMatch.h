@@ -0,0 +1,73 @@
+#ifndef TAGMATCH_H
+#define TAGMATCH_H
+
+#include <stdint.h>
+
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/*
+Vectorized tag comparison for set lookup. The tags of a set are stored
+next to each other, so instead of checking the ways one by one we
+compare a whole vector of tags against the wanted one at a time and
+collect the results into a bitmask (bit i set if way i matches).
+
+Tags are 64 bits, so a vector holds 4 (AVX2) or 2 (SSE2) of them.
+The vector loops may read up to TAG_PADDING - 1 tags past the end of
+the set, so tag arrays must be allocated with TAG_PADDING spare
+entries at the end. The extra bits are masked off before returning.
+*/
+
+#define TAG_PADDING 4
+
+/* Bits 0 to n - 1 set, for 1 <= n <= 64. */
+static inline uint64_t lowMask(uint32_t n) {
+  return n >= 64 ? ~0ULL : (1ULL << n) - 1;
+}
+
+/* Compares n (1 to 64) consecutive tags against tag. */
+static inline uint64_t matchTags(const uint64_t *tags, uint32_t n, uint64_t tag) {
+
+  uint64_t mask = 0;
+  uint32_t i = 0;
+
+  /*
+  Small sets (direct-mapped, 2-way) are cheaper to check directly than
+  to load into a vector. When n is a compile-time constant this choice
+  disappears.
+  */
+  if (n < 4) {
+    for (; i < n; i++)
+      mask |= (uint64_t)(tags[i] == tag) << i;
+    return mask;
+  }
+
+#if defined(__AVX2__)
+  __m256i key = _mm256_set1_epi64x((long long)tag);
+  for (; i < n; i += 4) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)&tags[i]);
+    __m256i eq = _mm256_cmpeq_epi64(v, key);
+    mask |= (uint64_t)(uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(eq)) << i;
+  }
+#elif defined(__SSE2__)
+  /*
+  SSE2 has no 64-bit compare, so we compare the 32-bit halves and keep
+  the lanes where both halves matched.
+  */
+  __m128i key = _mm_set1_epi64x((long long)tag);
+  for (; i < n; i += 2) {
+    __m128i v = _mm_loadu_si128((const __m128i *)&tags[i]);
+    __m128i eq = _mm_cmpeq_epi32(v, key);
+    eq = _mm_and_si128(eq, _mm_shuffle_epi32(eq, _MM_SHUFFLE(2, 3, 0, 1)));
+    mask |= (uint64_t)(uint32_t)_mm_movemask_pd(_mm_castsi128_pd(eq)) << i;
+  }
+#else
+  for (; i < n; i++)
+    mask |= (uint64_t)(tags[i] == tag) << i;
+#endif
+
+  return mask & lowMask(n);
+}
+
+#endif
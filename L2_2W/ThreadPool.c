@@ -0,0 +1,128 @@
+#include "ThreadPool.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/*
+Each worker owns a range of task numbers, packed as (next << 32 | end)
+in one atomic word. The owner takes tasks from the front and thieves
+cut the back half off, both with a compare-and-swap on the same word,
+so no locks are needed. Workers are padded to a host cache line so
+their ranges don't share one.
+*/
+typedef struct PoolWorker {
+  _Atomic uint64_t range;
+  uint32_t id;
+  pthread_t thread;
+  struct Pool *pool;
+} __attribute__((aligned(64))) PoolWorker;
+
+typedef struct Pool {
+  PoolWorker *workers;
+  uint32_t count;
+  PoolTask task;
+  void *arg;
+} Pool;
+
+static uint64_t packRange(uint32_t next, uint32_t end) { return (uint64_t)next << 32 | end; }
+
+static int takeOwn(PoolWorker *worker, uint32_t *task) {
+
+  uint64_t range = atomic_load(&worker->range);
+
+  for (;;) {
+    uint32_t next = range >> 32, end = (uint32_t)range;
+    if (next >= end)
+      return 0;
+    if (atomic_compare_exchange_weak(&worker->range, &range, packRange(next + 1, end))) {
+      *task = next;
+      return 1;
+    }
+  }
+}
+
+/*
+Moves the back half of some other worker's range into ours. Only we
+write our own range while it's empty, so a plain store is enough.
+*/
+static int steal(Pool *pool, PoolWorker *self) {
+
+  for (uint32_t i = 1; i < pool->count; i++) {
+    PoolWorker *victim = &pool->workers[(self->id + i) % pool->count];
+    uint64_t range = atomic_load(&victim->range);
+
+    for (;;) {
+      uint32_t next = range >> 32, end = (uint32_t)range;
+      if (next >= end)
+        break;
+      uint32_t split = end - (end - next + 1) / 2;
+      if (atomic_compare_exchange_weak(&victim->range, &range, packRange(next, split))) {
+        atomic_store(&self->range, packRange(split, end));
+        return 1;
+      }
+    }
+  }
+  return 0;
+}
+
+static void *workerMain(void *arg) {
+
+  PoolWorker *self = arg;
+  Pool *pool = self->pool;
+  uint32_t task;
+
+  do {
+    while (takeOwn(self, &task))
+      pool->task(task, self->id, pool->arg);
+  } while (steal(pool, self));
+
+  return NULL;
+}
+
+int runPool(uint32_t count, uint32_t workers, PoolTask task, void *arg) {
+
+  Pool pool = {NULL, workers ? workers : 1, task, arg};
+  uint32_t started = 0;
+  int ret = 0;
+
+  pool.workers = aligned_alloc(64, pool.count * sizeof(PoolWorker));
+  if (pool.workers == NULL)
+    return -1;
+
+  for (uint32_t w = 0; w < pool.count; w++) {
+    PoolWorker *worker = &pool.workers[w];
+    uint32_t first = (uint32_t)((uint64_t)count * w / pool.count);
+    uint32_t last = (uint32_t)((uint64_t)count * (w + 1) / pool.count);
+    atomic_init(&worker->range, packRange(first, last));
+    worker->id = w;
+    worker->pool = &pool;
+  }
+
+  /*
+  If some threads fail to start, the ones that did will steal the
+  orphaned ranges, so the tasks still all run.
+  */
+  for (uint32_t w = 0; w < pool.count; w++) {
+    if (pthread_create(&pool.workers[w].thread, NULL, workerMain, &pool.workers[w]) != 0)
+      break;
+    started++;
+  }
+
+  if (started == 0)
+    ret = -1;
+
+  for (uint32_t w = 0; w < started; w++)
+    pthread_join(pool.workers[w].thread, NULL);
+
+  free(pool.workers);
+  return ret;
+}
+
+uint32_t onlineCpus(void) {
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+
+  return cpus > 0 ? (uint32_t)cpus : 1;
+}
@@ -0,0 +1,26 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <stdint.h>
+
+/*
+A small work-stealing pool for running independent tasks (e.g. one
+simulation per configuration) on every core. Kept out of the simulator
+files because <unistd.h> declares its own read() and write().
+*/
+
+/* Runs task number task on the given worker thread. */
+typedef void (*PoolTask)(uint32_t task, uint32_t worker, void *arg);
+
+/*
+Runs tasks 0 to count - 1 on workers threads and returns once all of
+them are done. Each worker starts with a contiguous share of the tasks
+and, when it runs out, steals half of what's left from another worker.
+Returns 0 on success and -1 if the threads couldn't be started.
+*/
+int runPool(uint32_t count, uint32_t workers, PoolTask task, void *arg);
+
+/* Number of cores currently online, at least 1. */
+uint32_t onlineCpus(void);
+
+#endif
@@ -0,0 +1,70 @@
+#include "Trace.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*
+This file is kept apart from the simulator because <unistd.h> declares
+its own read() and write(), which clash with our cache interface.
+*/
+
+int mapTrace(const char *path, Trace *trace) {
+
+  struct stat st;
+  const TraceHeader *header;
+  int fd;
+
+  fd = open(path, O_RDONLY);
+  if (fd < 0)
+    return -1;
+
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    return -1;
+  }
+
+  if ((size_t)st.st_size < sizeof(TraceHeader)) {
+    close(fd);
+    errno = EINVAL;
+    return -1;
+  }
+
+  trace->length = (size_t)st.st_size;
+  trace->base = mmap(NULL, trace->length, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd); // the mapping keeps its own reference to the file
+  if (trace->base == MAP_FAILED)
+    return -1;
+
+  header = (const TraceHeader *)trace->base;
+  if (header->Magic != TRACE_MAGIC || header->Version != TRACE_VERSION ||
+      header->Count > (trace->length - sizeof(TraceHeader)) / sizeof(TraceRecord)) {
+    munmap(trace->base, trace->length);
+    errno = EINVAL;
+    return -1;
+  }
+
+  /*
+  Replay walks the records front to back exactly once, so we tell the
+  kernel to read ahead aggressively and drop pages behind us.
+  */
+  madvise(trace->base, trace->length, MADV_SEQUENTIAL);
+  madvise(trace->base, trace->length, MADV_WILLNEED);
+
+  trace->records = (const TraceRecord *)(header + 1);
+  trace->count = header->Count;
+  return 0;
+}
+
+int unmapTrace(Trace *trace) {
+
+  int ret = munmap(trace->base, trace->length);
+
+  trace->records = NULL;
+  trace->count = 0;
+  trace->base = NULL;
+  trace->length = 0;
+  return ret;
+}
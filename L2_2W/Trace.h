@@ -0,0 +1,44 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+Binary trace format. A trace file is a TraceHeader followed by Count
+fixed-size TraceRecords, all little-endian. Records and the header are
+16 bytes each, so once the file is mapped the records are naturally
+aligned and can be walked as a plain array - no per-record parsing.
+
+Version 2 widened addresses from 32 to 64 bits (and records from 8 to
+16 bytes); version 1 files are no longer accepted.
+*/
+
+#define TRACE_MAGIC 0x31435254 // "TRC1"
+#define TRACE_VERSION 2
+
+typedef struct TraceHeader {
+  uint32_t Magic;
+  uint32_t Version;
+  uint64_t Count; // number of records following the header
+} TraceHeader;
+
+typedef struct TraceRecord {
+  uint64_t Address;
+  uint8_t Mode;  // MODE_READ or MODE_WRITE
+  uint8_t Width; // in bytes
+  uint8_t Reserved[6];
+} TraceRecord;
+
+typedef struct Trace {
+  const TraceRecord *records;
+  uint64_t count;
+  void *base;    // start of the mapping
+  size_t length; // length of the mapping
+} Trace;
+
+/* Both return 0 on success and -1 (with errno set) on failure. */
+int mapTrace(const char *, Trace *);
+int unmapTrace(Trace *);
+
+#endif
@@ -0,0 +1,138 @@
+#include "Cache.h"
+#include "PackedTrace.h"
+#include "Trace.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+Converts a trace into the packed format (see PackedTrace.h). The input
+is either a binary trace or a text one, with one access per line:
+
+  Read; Address 4; Value 4; Time 106     as in L1/results_L1.txt
+  W 0x1f40 8                             mode, address and width
+
+A line is an access if its first word starts with R or W; the address
+follows, optionally after "Address", and a width in bytes may follow
+that (WORD_SIZE if not). Other lines are ignored. Records are packed as
+they are read, so neither trace is ever held in memory.
+*/
+
+static int usage(const char *name) {
+  fprintf(stderr, "Usage: %s <trace file> <packed trace file> [-b records per block]\n", name);
+  return 1;
+}
+
+/* Parses one text line into a record. Returns 0 if it isn't an access. */
+static int parseLine(const char *line, TraceRecord *record) {
+
+  const char *p = line;
+  char *end;
+
+  while (isspace((unsigned char)*p))
+    p++;
+  if (toupper((unsigned char)*p) != 'R' && toupper((unsigned char)*p) != 'W')
+    return 0;
+
+  memset(record, 0, sizeof(*record));
+  record->Mode = toupper((unsigned char)*p) == 'R' ? MODE_READ : MODE_WRITE;
+  record->Width = WORD_SIZE;
+
+  while (*p != '\0' && *p != ';' && !isspace((unsigned char)*p))
+    p++;
+  while (*p == ';' || isspace((unsigned char)*p))
+    p++;
+  if (strncmp(p, "Address", 7) == 0)
+    p += 7;
+  while (*p == ' ' || *p == '\t')
+    p++;
+  if (!isdigit((unsigned char)*p))
+    return 0;
+
+  record->Address = strtoull(p, &end, 0);
+  p = end;
+  while (*p == ' ' || *p == '\t')
+    p++;
+  if (isdigit((unsigned char)*p)) {
+    unsigned long width = strtoul(p, NULL, 0);
+    if (width == 0 || width > 255)
+      return 0;
+    record->Width = (uint8_t)width;
+  }
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  Trace trace;
+  PackedWriter writer;
+  TraceRecord record;
+  uint32_t blockRecords = PACKED_BLOCK_RECORDS;
+  uint64_t ignored = 0;
+  int binary;
+  FILE *out;
+
+  if (argc != 3 && argc != 5)
+    return usage(argv[0]);
+  if (argc == 5) {
+    if (strcmp(argv[3], "-b") != 0 || (blockRecords = (uint32_t)strtoul(argv[4], NULL, 0)) == 0)
+      return usage(argv[0]);
+  }
+
+  binary = mapTrace(argv[1], &trace) == 0;
+  if (!binary && errno != EINVAL) {
+    fprintf(stderr, "Could not open trace %s: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+
+  if ((out = fopen(argv[2], "wb")) == NULL || beginPackedTrace(&writer, out, blockRecords) < 0) {
+    fprintf(stderr, "Could not write %s: %s\n", argv[2], strerror(errno));
+    return 1;
+  }
+
+  if (binary) {
+    for (uint64_t i = 0; i < trace.count; i++) {
+      if (packRecord(&writer, &trace.records[i]) < 0) {
+        fprintf(stderr, "Could not pack record %llu: %s\n", (unsigned long long)i,
+                strerror(errno));
+        return 1;
+      }
+    }
+    unmapTrace(&trace);
+  } else {
+    char line[512];
+    FILE *in = fopen(argv[1], "r");
+
+    if (in == NULL) {
+      fprintf(stderr, "Could not open trace %s: %s\n", argv[1], strerror(errno));
+      return 1;
+    }
+    while (fgets(line, sizeof(line), in) != NULL) {
+      if (!parseLine(line, &record)) {
+        ignored++;
+        continue;
+      }
+      if (packRecord(&writer, &record) < 0) {
+        fprintf(stderr, "Could not write %s: %s\n", argv[2], strerror(errno));
+        return 1;
+      }
+    }
+    fclose(in);
+  }
+
+  if (endPackedTrace(&writer) < 0 || fclose(out) != 0) {
+    fprintf(stderr, "Could not write %s: %s\n", argv[2], strerror(errno));
+    return 1;
+  }
+
+  printf("Records: %llu\n", (unsigned long long)writer.count);
+  if (!binary)
+    printf("Ignored lines: %llu\n", (unsigned long long)ignored);
+  printf("Packed size: %llu bytes\n", (unsigned long long)writer.offset);
+  if (writer.count > 0)
+    printf("Bytes per record: %.2f\n", (double)writer.offset / (double)writer.count);
+  return 0;
+}
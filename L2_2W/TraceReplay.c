@@ -0,0 +1,335 @@
+#include "Checkpoint.h"
+#include "Events.h"
+#include "Replay.h"
+
+#include <errno.h>
+#include <inttypes.h>
+#include <math.h>
+#include <time.h>
+
+/*
+Replays a binary trace (see Trace.h) or a packed one (see PackedTrace.h)
+through the caches. The trace is memory mapped and walked in place or
+decoded as we go (see Replay.c), and nothing is printed until the final
+summary. With -ss or -is the replay is sampled (see sampleTrace) and we
+print estimates instead of exact figures. Given several traces, each one runs
+on a core of its own, all of them sharing the L2.
+
+-save writes a checkpoint of the simulator (see Checkpoint.h) once the
+replay is over, with the data unless it is timing-only. -load starts
+from one instead of from empty caches: the configuration is the
+checkpoint's, so none of the cache options can be given, and the
+statistics and time only cover the replay that follows.
+
+-events records what the caches do during the replay into an event
+file for EventDump, in builds with event tracing (see Events.h).
+*/
+
+/*
+Parses a "size,block,ways[,policy]" geometry, all in bytes except ways.
+The policy is a name understood by parsePolicy and defaults to LRU.
+*/
+static int parseGeometry(const char *arg, CacheGeometry *g) {
+
+  char policy[16];
+  int fields, parsed;
+
+  memset(g, 0, sizeof(*g));
+  fields = sscanf(arg, "%u,%u,%u,%15s", &g->Size, &g->BlockSize, &g->Ways, policy);
+  if (fields == 4) {
+    if ((parsed = parsePolicy(policy)) < 0)
+      return -1;
+    g->Policy = (uint32_t)parsed;
+  }
+  return fields >= 3 ? 0 : -1;
+}
+
+/*
+Parses a "type,degree[,entries]" prefetcher, the type being a name
+understood by parsePrefetcher. Entries defaults to 16.
+*/
+static int parsePrefetch(const char *arg, PrefetchConfig *p) {
+
+  char spec[32], *comma;
+  int type;
+
+  snprintf(spec, sizeof(spec), "%s", arg);
+  *p = (PrefetchConfig){.Entries = 16};
+  if ((comma = strchr(spec, ',')) != NULL)
+    *comma = '\0';
+  if ((type = parsePrefetcher(spec)) < 0)
+    return -1;
+  p->Type = (uint32_t)type;
+  if (type == PREFETCH_NONE)
+    return 0;
+  if (comma == NULL || sscanf(comma + 1, "%u,%u", &p->Degree, &p->Entries) < 1)
+    return -1;
+  return 0;
+}
+
+/* Parses "ratio[,groups]" set sampling, with 8 groups by default. */
+static int parseSetSampling(const char *arg, SamplingConfig *config) {
+
+  if (sscanf(arg, "%u,%u", &config->SetRatio, &config->Groups) == 1)
+    config->Groups = 8;
+  return config->SetRatio > 0 ? 0 : -1;
+}
+
+static void printEstimate(const char *name, const Estimate *e) {
+  if (isnan(e->Error))
+    printf("%s: %.6g\n", name, e->Value);
+  else
+    printf("%s: %.6g +- %.3g\n", name, e->Value, e->Error);
+}
+
+static int usage(const char *name) {
+  fprintf(stderr, "Usage: %s <trace file>... [-l1 size,block,ways[,policy]] "
+                  "[-l2 size,block,ways[,policy]] [-t] "
+                  "[-m memory size] [-wt] [-nwa] [-wb buffer entries] "
+                  "[-p1 type,degree[,entries]] [-p2 type,degree[,entries]] [-mshr count]\n"
+                  "       [-vc victim cache entries] [-inc nine|inclusive|exclusive]\n"
+                  "       [-ss set ratio[,groups]] [-is window,period] "
+                  "[-save checkpoint] [-load checkpoint] [-events event file]\n", name);
+  return 1;
+}
+
+static double elapsedSeconds(struct timespec *start, struct timespec *end) {
+  return (double)(end->tv_sec - start->tv_sec) +
+         (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+int main(int argc, char **argv) {
+
+  Simulator sim;
+  TraceInput traces[MAX_CORES];
+  CacheGeometry l1 = {.Size = L1_SIZE, .BlockSize = BLOCK_SIZE, .Ways = L1_WAYS};
+  CacheGeometry l2 = {.Size = L2_SIZE, .BlockSize = BLOCK_SIZE, .Ways = L2_WAYS};
+  struct timespec start, end;
+  ReplayResult result;
+  SamplingConfig sampling = {1, 1, 0, 0};
+  SampleResult sample;
+  uint32_t timingOnly = 0;
+  uint32_t mshrs = 0;
+  uint32_t victims = 0;
+  int inclusion = INCLUSION_NINE;
+  uint64_t memorySize = 0;
+  WritePolicy writePolicy = {0, 0, 0};
+  PrefetchConfig prefetch[2] = {{PREFETCH_NONE, 0, 0}, {PREFETCH_NONE, 0, 0}};
+  uint64_t records = 0, startTime, events = 0;
+  uint32_t cores = 0, sampled, configured = 0;
+  const char *saveTo = NULL, *loadFrom = NULL, *eventsTo = NULL;
+  double seconds;
+  int i;
+
+  // The trace files come first, one per core
+  for (i = 1; i < argc && argv[i][0] != '-'; i++)
+    cores++;
+  if (cores == 0)
+    return usage(argv[0]);
+  if (cores > MAX_CORES) {
+    fprintf(stderr, "At most %d traces\n", MAX_CORES);
+    return 1;
+  }
+
+  for (; i < argc; i++) {
+    configured |= strcmp(argv[i], "-ss") != 0 && strcmp(argv[i], "-is") != 0 &&
+                  strcmp(argv[i], "-save") != 0 && strcmp(argv[i], "-load") != 0 &&
+                  strcmp(argv[i], "-events") != 0;
+    if (strcmp(argv[i], "-t") == 0)
+      timingOnly = 1;
+    else if (i + 1 < argc && strcmp(argv[i], "-l1") == 0 && parseGeometry(argv[++i], &l1) == 0)
+      continue;
+    else if (i + 1 < argc && strcmp(argv[i], "-l2") == 0 && parseGeometry(argv[++i], &l2) == 0)
+      continue;
+    else if (i + 1 < argc && strcmp(argv[i], "-m") == 0)
+      memorySize = strtoull(argv[++i], NULL, 0);
+    else if (strcmp(argv[i], "-wt") == 0)
+      writePolicy.WriteThrough = 1;
+    else if (strcmp(argv[i], "-nwa") == 0)
+      writePolicy.NoWriteAllocate = 1;
+    else if (i + 1 < argc && strcmp(argv[i], "-wb") == 0)
+      writePolicy.BufferEntries = (uint32_t)strtoul(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-mshr") == 0)
+      mshrs = (uint32_t)strtoul(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-vc") == 0)
+      victims = (uint32_t)strtoul(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-inc") == 0 &&
+             (inclusion = parseInclusion(argv[++i])) >= 0)
+      continue;
+    else if (i + 1 < argc && strcmp(argv[i], "-ss") == 0 &&
+             parseSetSampling(argv[++i], &sampling) == 0)
+      continue;
+    else if (i + 1 < argc && strcmp(argv[i], "-is") == 0 &&
+             sscanf(argv[++i], "%" SCNu64 ",%" SCNu64, &sampling.Window,
+                    &sampling.Period) == 2)
+      continue;
+    else if (i + 1 < argc && strcmp(argv[i], "-save") == 0)
+      saveTo = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "-load") == 0)
+      loadFrom = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "-events") == 0)
+      eventsTo = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "-p1") == 0 &&
+             parsePrefetch(argv[++i], &prefetch[0]) == 0)
+      continue;
+    else if (i + 1 < argc && strcmp(argv[i], "-p2") == 0 &&
+             parsePrefetch(argv[++i], &prefetch[1]) == 0)
+      continue;
+    else
+      return usage(argv[0]);
+  }
+
+  sampled = sampling.SetRatio > 1 || sampling.Window > 0;
+  if (eventsTo != NULL && EVENT_TRACE == 0) {
+    fprintf(stderr, "Built without event tracing, see EVENT_TRACE in the Makefile\n");
+    return 1;
+  }
+  if (loadFrom != NULL && configured) {
+    fprintf(stderr, "With -load the configuration comes from the checkpoint\n");
+    return 1;
+  }
+
+  initSimulator(&sim);
+  setCores(&sim, cores);
+  if (configureCaches(&sim, &l1, &l2) < 0) {
+    fprintf(stderr, "Invalid cache geometry\n");
+    return 1;
+  }
+
+  if (setInclusion(&sim, (uint32_t)inclusion) < 0) {
+    fprintf(stderr, "An exclusive hierarchy needs the same block size in L1 and L2\n");
+    return 1;
+  }
+
+  if (setWritePolicy(&sim, &writePolicy) < 0) {
+    fprintf(stderr, "At most %d write buffer entries\n", MAX_WRITE_BUFFER);
+    return 1;
+  }
+
+  if (setMSHRs(&sim, mshrs) < 0) {
+    fprintf(stderr, "At most %d MSHRs\n", MAX_MSHRS);
+    return 1;
+  }
+
+  if (setVictimCache(&sim, victims) < 0) {
+    fprintf(stderr, "At most %d victim cache entries\n", MAX_VICTIMS);
+    return 1;
+  }
+
+  for (uint32_t level = 1; level <= 2; level++) {
+    if (setPrefetcher(&sim, level, &prefetch[level - 1]) < 0) {
+      fprintf(stderr, "Invalid L%u prefetcher\n", level);
+      return 1;
+    }
+  }
+
+  if (loadFrom != NULL) {
+    if (loadCheckpoint(&sim, loadFrom) < 0) {
+      fprintf(stderr, "Could not load checkpoint %s: %s\n", loadFrom, strerror(errno));
+      return 1;
+    }
+    if (sim.core_count != cores) {
+      fprintf(stderr, "The checkpoint takes %u traces, one per core\n", sim.core_count);
+      return 1;
+    }
+  }
+
+  for (uint32_t c = 0; c < cores; c++) {
+    if (openTraceInput(argv[c + 1], &traces[c]) < 0) {
+      fprintf(stderr, "Could not open trace %s: %s\n", argv[c + 1], strerror(errno));
+      return 1;
+    }
+    records += traces[c].count;
+  }
+
+  // Sampling leaves the data behind, so it only simulates timing
+  if (sampled) {
+    if (cores > 1) {
+      fprintf(stderr, "Sampling takes a single trace\n");
+      return 1;
+    }
+    if (loadFrom != NULL && !sim.timing_only) {
+      fprintf(stderr, "Sampling needs a timing-only checkpoint\n");
+      return 1;
+    }
+    timingOnly = 1;
+  }
+
+  /*
+  A checkpoint keeps its clock: its prefetches and write buffer drains
+  are timed against it. We only count the time from here on.
+  */
+  if (loadFrom == NULL) {
+    setTimingOnly(&sim, timingOnly);
+    setMemorySize(&sim, memorySize);
+    resetTime(&sim);
+    initL1Cache(&sim);
+    initL2Cache(&sim);
+  }
+  resetStats(&sim);
+  startTime = getTime(&sim);
+
+  if (eventsTo != NULL && startEvents(eventsTo) < 0) {
+    fprintf(stderr, "Could not create event file %s: %s\n", eventsTo, strerror(errno));
+    return 1;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (sampled) {
+    if (sampleTrace(&sim, &traces[0], &sampling, &sample) < 0) {
+      fprintf(stderr, "Invalid sampling: at most %d groups, a period no shorter than the "
+                      "window, and L1 and L2 sets spanning more than the larger block\n",
+              MAX_SAMPLE_GROUPS);
+      return 1;
+    }
+    result.accesses = sample.accesses;
+    result.skipped = sample.skipped;
+  } else if (cores == 1)
+    replayTrace(&sim, &traces[0], &result);
+  else
+    replayTraces(&sim, traces, cores, &result);
+  waitForMisses(&sim);
+  flushWriteBuffer(&sim);
+
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  seconds = elapsedSeconds(&start, &end);
+
+  if (eventsTo != NULL && stopEvents(&events) < 0) {
+    fprintf(stderr, "Could not write event file %s: %s\n", eventsTo, strerror(errno));
+    return 1;
+  }
+
+  printf("Records: %llu\n", (unsigned long long)records);
+  printf("Accesses: %llu\n", (unsigned long long)result.accesses);
+  printf("Skipped: %llu\n", (unsigned long long)result.skipped);
+  printf("Simulated time: %llu\n", (unsigned long long)(getTime(&sim) - startTime));
+  printf("Wall time: %.3f s\n", seconds);
+  if (eventsTo != NULL)
+    printf("Events: %llu\n", (unsigned long long)events);
+  if (seconds > 0)
+    printf("Accesses per second: %.0f\n", (double)result.accesses / seconds);
+  printf("\n");
+
+  if (sampled) {
+    printf("Detailed accesses: %llu\n", (unsigned long long)sample.detailed);
+    printf("Warmed accesses: %llu\n", (unsigned long long)sample.warmed);
+    printf("Sample units: %llu\n", (unsigned long long)sample.units);
+    printEstimate("L1 miss rate", &sample.l1MissRate);
+    printEstimate("L2 miss rate", &sample.l2MissRate);
+    printEstimate("Cycles per access", &sample.cyclesPerAccess);
+    printEstimate("Estimated time", &sample.time);
+    printf("\nStatistics of the detailed accesses only:\n");
+  }
+  printStats(&sim, stdout);
+
+  if (saveTo != NULL && saveCheckpoint(&sim, saveTo, 1) < 0) {
+    fprintf(stderr, "Could not save checkpoint %s: %s\n", saveTo, strerror(errno));
+    return 1;
+  }
+
+  freeSimulator(&sim);
+  for (uint32_t c = 0; c < cores; c++)
+    closeTraceInput(&traces[c]);
+  return 0;
+}
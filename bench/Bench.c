@@ -0,0 +1,375 @@
+/*
+Throughput benchmark of the simulators. The same source is built once
+per variant (see the bench target of the Makefile):
+
+  -DBENCH_L1   L1/ (direct-mapped L1)
+  -DBENCH_L2   L2/ (L1 and a direct-mapped L2)
+  neither      L2_2W/ (the full hierarchy, default configuration)
+
+Each pattern below is run a few times from empty caches (but for
+pointer chasing, see buildChain), and for the fastest run we print one
+CSV line:
+
+  variant,pattern,accesses,runs,seconds,accesses_per_second,ns_per_access,simulated_time
+
+simulated_time is what the simulator's clock said at the end, so a
+change there between two builds means the simulation itself changed,
+not just its speed. With -c, the results are also compared with an
+earlier CSV file (any variant's lines, the others are ignored): every
+pattern that got slower by more than the tolerance (-t, 5% by default)
+is reported on stderr, and the exit status is 2 if there was one.
+
+All addresses lie in the DRAM_SIZE bytes the L1 and L2 variants
+simulate, so every variant runs exactly the same accesses.
+*/
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(BENCH_L1)
+#include "L1Cache.h"
+
+#define VARIANT "L1"
+
+static void resetClock(void) { resetTime(); }
+
+static void emptyCaches(void) { initCache(); }
+
+static void readWord(uint32_t address, uint8_t *data) { read(address, data); }
+
+static void writeWord(uint32_t address, uint8_t *data) { write(address, data); }
+
+static uint64_t simulatedTime(void) { return getTime(); }
+
+#elif defined(BENCH_L2)
+#include "L2Cache.h"
+
+#define VARIANT "L2"
+
+static void resetClock(void) { resetTime(); }
+
+static void emptyCaches(void) {
+  initL1Cache();
+  initL2Cache();
+}
+
+static void readWord(uint32_t address, uint8_t *data) { read(address, data); }
+
+static void writeWord(uint32_t address, uint8_t *data) { write(address, data); }
+
+static uint64_t simulatedTime(void) { return getTime(); }
+
+#else
+#include "L2_2WCache.h"
+
+#define VARIANT "L2_2W"
+
+static Simulator sim;
+
+static void resetClock(void) {
+  resetTime(&sim);
+  resetStats(&sim);
+}
+
+static void emptyCaches(void) {
+  initL1Cache(&sim);
+  initL2Cache(&sim);
+}
+
+static void readWord(uint32_t address, uint8_t *data) { read(&sim, address, data); }
+
+static void writeWord(uint32_t address, uint8_t *data) { write(&sim, address, data); }
+
+static uint64_t simulatedTime(void) { return getTime(&sim); }
+
+#endif
+
+#define DEFAULT_ACCESSES (1 << 22)
+#define DEFAULT_RUNS 5
+#define DEFAULT_TOLERANCE 5.0 // percent
+#define STRIDE (5 * BLOCK_SIZE) // odd in blocks, so it goes through every block
+#define MAX_RESULTS 16
+
+typedef struct Pattern {
+  const char *name;
+  void (*generate)(uint32_t *, uint8_t *, uint64_t); // NULL for pointer chasing
+} Pattern;
+
+typedef struct Result {
+  char variant[16];
+  char pattern[32];
+  uint64_t accesses;
+  uint32_t runs;
+  double seconds;
+  uint64_t simulatedTime;
+} Result;
+
+/*********************** Patterns *************************/
+
+#define SEED 0x2545f4914f6cdd1dULL
+
+static uint64_t xorshift(uint64_t *seed) {
+  *seed ^= *seed << 13;
+  *seed ^= *seed >> 7;
+  *seed ^= *seed << 17;
+  return *seed;
+}
+
+/* Every fourth access is a write, the rest are reads. */
+static uint8_t mixedMode(uint64_t i) { return i % 4 == 3 ? MODE_WRITE : MODE_READ; }
+
+static void sequential(uint32_t *addresses, uint8_t *modes, uint64_t count) {
+  for (uint64_t i = 0; i < count; i++) {
+    addresses[i] = (uint32_t)(i * WORD_SIZE % DRAM_SIZE);
+    modes[i] = mixedMode(i);
+  }
+}
+
+static void strided(uint32_t *addresses, uint8_t *modes, uint64_t count) {
+  for (uint64_t i = 0; i < count; i++) {
+    addresses[i] = (uint32_t)(i * STRIDE % DRAM_SIZE);
+    modes[i] = mixedMode(i);
+  }
+}
+
+static void uniform(uint32_t *addresses, uint8_t *modes, uint64_t count) {
+
+  uint64_t seed = SEED;
+
+  for (uint64_t i = 0; i < count; i++) {
+    addresses[i] = (uint32_t)(xorshift(&seed) % (DRAM_SIZE / WORD_SIZE) * WORD_SIZE);
+    modes[i] = mixedMode(i);
+  }
+}
+
+/*
+The accesses of tests/OurTest.c over and over: three blocks with the
+same L1 index and the same L2 set, written and then read back.
+*/
+static void conflict(uint32_t *addresses, uint8_t *modes, uint64_t count) {
+
+  static const uint32_t blocks[7] = {0, 16384, 32768, 0, 16384, 32768, 32768};
+
+  for (uint64_t i = 0; i < count; i++) {
+    addresses[i] = blocks[i % 7];
+    modes[i] = i % 7 < 3 ? MODE_WRITE : MODE_READ;
+  }
+}
+
+static const Pattern patterns[] = {
+    {"sequential", sequential},
+    {"strided", strided},
+    {"random", uniform},
+    {"conflict", conflict},
+    {"pointer-chase", NULL},
+};
+
+#define PATTERNS (sizeof(patterns) / sizeof(patterns[0]))
+
+/*
+Links every block into one cycle in random order, the first word of a
+block holding the address of the next one. It is written through the
+caches like any other data before the clock starts, and the caches are
+left as they are: emptying them would lose whatever is still dirty.
+*/
+static uint32_t buildChain(void) {
+
+  uint32_t order[DRAM_SIZE / BLOCK_SIZE];
+  uint32_t blocks = DRAM_SIZE / BLOCK_SIZE;
+  uint64_t seed = SEED;
+
+  for (uint32_t b = 0; b < blocks; b++)
+    order[b] = b;
+  for (uint32_t b = blocks - 1; b > 0; b--) {
+    uint32_t other = (uint32_t)(xorshift(&seed) % (b + 1)), swap = order[b];
+    order[b] = order[other];
+    order[other] = swap;
+  }
+
+  for (uint32_t b = 0; b < blocks; b++) {
+    uint32_t next = order[(b + 1) % blocks] * BLOCK_SIZE;
+    writeWord(order[b] * BLOCK_SIZE, (uint8_t *)&next);
+  }
+  return order[0] * BLOCK_SIZE;
+}
+
+/*********************** Running *************************/
+
+static double elapsedSeconds(struct timespec *start, struct timespec *end) {
+  return (double)(end->tv_sec - start->tv_sec) +
+         (double)(end->tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/* One run of a pattern from empty caches. Returns its wall time. */
+static double runPattern(const Pattern *pattern, const uint32_t *addresses, const uint8_t *modes,
+                         uint64_t count, uint64_t *simulated) {
+
+  struct timespec start, end;
+  uint32_t value = 0, next = 0;
+
+  emptyCaches();
+  if (pattern->generate == NULL)
+    next = buildChain();
+  resetClock();
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (pattern->generate == NULL) {
+    for (uint64_t i = 0; i < count; i++)
+      readWord(next, (uint8_t *)&next);
+  } else {
+    for (uint64_t i = 0; i < count; i++) {
+      if (modes[i] == MODE_READ)
+        readWord(addresses[i], (uint8_t *)&value);
+      else
+        writeWord(addresses[i], (uint8_t *)&value);
+      value++;
+    }
+  }
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  *simulated = simulatedTime();
+  return elapsedSeconds(&start, &end);
+}
+
+static void printResult(const Result *r) {
+  printf("%s,%s,%llu,%u,%.6f,%.0f,%.3f,%llu\n", r->variant, r->pattern,
+         (unsigned long long)r->accesses, r->runs, r->seconds, (double)r->accesses / r->seconds,
+         r->seconds * 1e9 / (double)r->accesses, (unsigned long long)r->simulatedTime);
+}
+
+/*
+Reads the lines of an earlier run that belong to this variant. Returns
+how many, or -1 if the file can't be read.
+*/
+static int readBaseline(const char *path, Result *results) {
+
+  char line[256];
+  int count = 0;
+  FILE *file = fopen(path, "r");
+
+  if (file == NULL)
+    return -1;
+
+  while (fgets(line, sizeof(line), file) != NULL && count < MAX_RESULTS) {
+    Result *r = &results[count];
+    unsigned long long accesses, simulated;
+    double perSecond, nanoseconds;
+
+    if (sscanf(line, "%15[^,],%31[^,],%llu,%u,%lf,%lf,%lf,%llu", r->variant, r->pattern,
+               &accesses, &r->runs, &r->seconds, &perSecond, &nanoseconds, &simulated) != 8 ||
+        strcmp(r->variant, VARIANT) != 0)
+      continue;
+    r->accesses = accesses;
+    r->simulatedTime = simulated;
+    count++;
+  }
+  fclose(file);
+  return count;
+}
+
+/* Reports how a result compares with the baseline. Returns 1 for a regression. */
+static int compareResult(const Result *r, const Result *baseline, int count, double tolerance) {
+
+  for (int i = 0; i < count; i++) {
+    const Result *b = &baseline[i];
+    double before, after, change;
+
+    if (strcmp(b->pattern, r->pattern) != 0)
+      continue;
+
+    before = b->seconds * 1e9 / (double)b->accesses;
+    after = r->seconds * 1e9 / (double)r->accesses;
+    change = (after - before) / before * 100;
+    fprintf(stderr, "%s %s: %.3f -> %.3f ns per access (%+.1f%%)%s\n", r->variant, r->pattern,
+            before, after, change, change > tolerance ? " REGRESSION" : "");
+    if (b->accesses == r->accesses && b->simulatedTime != r->simulatedTime)
+      fprintf(stderr, "%s %s: simulated time changed from %llu to %llu\n", r->variant,
+              r->pattern, (unsigned long long)b->simulatedTime,
+              (unsigned long long)r->simulatedTime);
+    return change > tolerance;
+  }
+
+  fprintf(stderr, "%s %s: not in the baseline\n", r->variant, r->pattern);
+  return 0;
+}
+
+static int usage(const char *name) {
+  fprintf(stderr, "Usage: %s [-n accesses] [-r runs] [-c baseline.csv] [-t tolerance %%]\n",
+          name);
+  return 1;
+}
+
+int main(int argc, char **argv) {
+
+  uint64_t count = DEFAULT_ACCESSES;
+  uint32_t runs = DEFAULT_RUNS;
+  double tolerance = DEFAULT_TOLERANCE;
+  const char *baselinePath = NULL;
+  Result baseline[MAX_RESULTS];
+  int baselineCount = 0, regressions = 0;
+  uint32_t *addresses;
+  uint8_t *modes;
+
+  for (int i = 1; i < argc; i++) {
+    if (i + 1 < argc && strcmp(argv[i], "-n") == 0)
+      count = strtoull(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-r") == 0)
+      runs = (uint32_t)strtoul(argv[++i], NULL, 0);
+    else if (i + 1 < argc && strcmp(argv[i], "-c") == 0)
+      baselinePath = argv[++i];
+    else if (i + 1 < argc && strcmp(argv[i], "-t") == 0)
+      tolerance = strtod(argv[++i], NULL);
+    else
+      return usage(argv[0]);
+  }
+  if (count == 0 || runs == 0)
+    return usage(argv[0]);
+
+  if (baselinePath != NULL && (baselineCount = readBaseline(baselinePath, baseline)) < 0) {
+    fprintf(stderr, "Could not read %s: %s\n", baselinePath, strerror(errno));
+    return 1;
+  }
+
+  addresses = malloc(count * sizeof(uint32_t));
+  modes = malloc(count);
+  if (addresses == NULL || modes == NULL)
+    exit(-1);
+
+#if !defined(BENCH_L1) && !defined(BENCH_L2)
+  initSimulator(&sim);
+#endif
+
+  printf("variant,pattern,accesses,runs,seconds,accesses_per_second,ns_per_access,"
+         "simulated_time\n");
+
+  for (uint32_t p = 0; p < PATTERNS; p++) {
+    Result r = {VARIANT, "", count, runs, 0, 0};
+
+    snprintf(r.pattern, sizeof(r.pattern), "%s", patterns[p].name);
+    if (patterns[p].generate != NULL)
+      patterns[p].generate(addresses, modes, count);
+
+    // The fastest run is the one least disturbed by the rest of the machine
+    for (uint32_t run = 0; run < runs; run++) {
+      double seconds = runPattern(&patterns[p], addresses, modes, count, &r.simulatedTime);
+      if (run == 0 || seconds < r.seconds)
+        r.seconds = seconds;
+    }
+
+    printResult(&r);
+    fflush(stdout);
+    if (baselinePath != NULL)
+      regressions += compareResult(&r, baseline, baselineCount, tolerance);
+  }
+
+#if !defined(BENCH_L1) && !defined(BENCH_L2)
+  freeSimulator(&sim);
+#endif
+  free(addresses);
+  free(modes);
+  return regressions > 0 ? 2 : 0;
+}
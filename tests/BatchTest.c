@@ -0,0 +1,223 @@
+// Place in same dir as L2_2WCache.h
+#include "L2_2WCache.h"
+#include "Events.h"
+
+/*
+Runs the same accesses through accessBatch on one simulator and through
+read() and write() on another, and checks that both end up with the
+same time, statistics, MSHRs and data, for every replacement policy,
+with and without prefetchers, MSHRs, a victim cache, a write buffer and
+a second core. The accesses come in runs to the same block, which
+accessBatch serves together. Built with EVENT_TRACE, the events of the
+two have to be the same as well.
+*/
+
+#define TEST_MEMORY (1 << 20)
+#define TEST_BATCHES 200
+#define MAX_BATCH 256
+#define HOT_MEMORY (1 << 15) // twice L1, reused enough for the replacement policy to matter
+
+typedef struct Setup {
+  uint32_t Policy;
+  uint32_t Ways;     // of L1, over 16 makes LRU keep access stamps
+  uint32_t Features; // 0 none, 1 prefetch and MSHRs, 2 everything
+  uint32_t Cores;
+  uint32_t WriteThrough;
+  uint32_t TimingOnly;
+} Setup;
+
+static uint64_t seed;
+
+static uint32_t testRandom(void) {
+  seed ^= seed << 13;
+  seed ^= seed >> 7;
+  seed ^= seed << 17;
+  return (uint32_t)(seed >> 16);
+}
+
+static void configure(Simulator *sim, const Setup *setup) {
+
+  CacheGeometry l1 = {.Size = 16384, .BlockSize = 64, .Ways = setup->Ways, .Policy = setup->Policy};
+  CacheGeometry l2 = {.Size = 131072, .BlockSize = 64, .Ways = 8, .Policy = setup->Policy};
+  WritePolicy writePolicy = {setup->WriteThrough, 0, setup->Features == 2 ? 4 : 0};
+  PrefetchConfig prefetch = {PREFETCH_NEXT_LINE + setup->Policy % 3, 2, 4};
+
+  initSimulator(sim);
+  setCores(sim, setup->Cores);
+  configureCaches(sim, &l1, &l2);
+  setWritePolicy(sim, &writePolicy);
+  setTimingOnly(sim, setup->TimingOnly);
+  setMemorySize(sim, TEST_MEMORY - 2); // the last word is out of memory
+  if (setup->Features > 0) {
+    setPrefetcher(sim, 1, &prefetch);
+    setMSHRs(sim, setup->Features == 2 ? 8 : 2);
+  }
+  if (setup->Features == 2)
+    setVictimCache(sim, 4);
+  resetTime(sim);
+  initL1Cache(sim);
+  initL2Cache(sim);
+}
+
+/*
+Sends the accesses of a setup to sim, in batches or one at a time,
+storing what the reads return in values. Returns how many accesses
+were rejected.
+*/
+static uint32_t run(Simulator *sim, const Setup *setup, uint32_t batched, uint32_t *values) {
+
+  uint64_t addresses[MAX_BATCH], address = 0;
+  uint8_t modes[MAX_BATCH];
+  uint32_t words[MAX_BATCH], rejected = 0;
+
+  seed = 0x2545f4914f6cdd1dULL + setup->Policy * 7919 + setup->Ways * 613 + setup->Features * 131 +
+         setup->Cores;
+
+  for (uint32_t b = 0; b < TEST_BATCHES; b++) {
+    uint32_t count = 1 + testRandom() % MAX_BATCH, core = testRandom() % setup->Cores;
+
+    // Mostly the next word, sometimes back a word, a block ahead or anywhere
+    for (uint32_t i = 0; i < count; i++) {
+      uint32_t step = testRandom() % 8;
+      if (step == 0)
+        address = testRandom() % (testRandom() % 2 ? HOT_MEMORY : TEST_MEMORY);
+      else if (step < 5)
+        address += WORD_SIZE;
+      else if (step == 5)
+        address += BLOCK_SIZE;
+      else if (step == 6)
+        address -= WORD_SIZE;
+      address = address % TEST_MEMORY & ~(uint64_t)(WORD_SIZE - 1);
+      addresses[i] = address;
+      modes[i] = testRandom() % 3 == 0 ? MODE_WRITE : MODE_READ;
+      words[i] = testRandom();
+    }
+
+    selectCore(sim, core);
+    if (batched)
+      rejected += accessBatch(sim, addresses, modes, (uint8_t *)words, count);
+    for (uint32_t i = 0; !batched && i < count; i++) {
+      uint8_t *word = (uint8_t *)&words[i];
+      rejected += (modes[i] == MODE_READ ? read(sim, addresses[i], word)
+                                         : write(sim, addresses[i], word)) < 0;
+    }
+    memcpy(&values[b * MAX_BATCH], words, count * sizeof(uint32_t));
+  }
+
+  waitForMisses(sim);
+  flushWriteBuffer(sim);
+  return rejected;
+}
+
+static int sameCore(const Core *a, const Core *b) {
+  return a->time == b->time && a->mshr_file.count == b->mshr_file.count &&
+         memcmp(a->mshr_file.entries, b->mshr_file.entries,
+                a->mshr_file.count * sizeof(MSHR)) == 0;
+}
+
+/* Reads every word of memory back from both, leaving them as alike as they were. */
+static int sameMemory(Simulator *a, Simulator *b) {
+
+  uint32_t x, y;
+
+  for (uint64_t address = 0; address < TEST_MEMORY - WORD_SIZE; address += WORD_SIZE) {
+    x = y = 0;
+    read(a, address, (uint8_t *)&x);
+    read(b, address, (uint8_t *)&y);
+    if (x != y)
+      return 0;
+  }
+  return 1;
+}
+
+static int sameFiles(const char *a, const char *b) {
+
+  FILE *fa = fopen(a, "rb"), *fb = fopen(b, "rb");
+  int ca, cb, same = fa != NULL && fb != NULL;
+
+  while (same) {
+    ca = fgetc(fa);
+    cb = fgetc(fb);
+    same = ca == cb;
+    if (ca == EOF)
+      break;
+  }
+  if (fa != NULL)
+    fclose(fa);
+  if (fb != NULL)
+    fclose(fb);
+  return same;
+}
+
+static int test(const Setup *setup) {
+
+  static uint32_t batchValues[TEST_BATCHES * MAX_BATCH], accessValues[TEST_BATCHES * MAX_BATCH];
+  Simulator batch, access;
+  Stats batchStats, accessStats;
+  uint32_t batchRejected, accessRejected;
+  int same;
+
+  memset(batchValues, 0, sizeof(batchValues));
+  memset(accessValues, 0, sizeof(accessValues));
+
+  configure(&batch, setup);
+  if (EVENT_TRACE > 0)
+    startEvents("BatchTest.batch.evt");
+  batchRejected = run(&batch, setup, 1, batchValues);
+  if (EVENT_TRACE > 0)
+    stopEvents(NULL);
+
+  configure(&access, setup);
+  if (EVENT_TRACE > 0)
+    startEvents("BatchTest.access.evt");
+  accessRejected = run(&access, setup, 0, accessValues);
+  if (EVENT_TRACE > 0)
+    stopEvents(NULL);
+
+  getStats(&batch, &batchStats);
+  getStats(&access, &accessStats);
+  same = batchRejected == accessRejected && getTime(&batch) == getTime(&access) &&
+         memcmp(&batchStats, &accessStats, sizeof(Stats)) == 0;
+  for (uint32_t c = 0; c < setup->Cores; c++)
+    same = same && sameCore(&batch.cores[c], &access.cores[c]);
+  if (!setup->TimingOnly)
+    same = same && memcmp(batchValues, accessValues, sizeof(batchValues)) == 0 &&
+           sameMemory(&batch, &access);
+  if (EVENT_TRACE > 0)
+    same = same && sameFiles("BatchTest.batch.evt", "BatchTest.access.evt");
+
+  printf("Policy %s; Ways %u; Features %u; Cores %u; Write-through %u; Timing-only %u; "
+         "Time %llu; %s\n",
+         policyName(setup->Policy), setup->Ways, setup->Features, setup->Cores,
+         setup->WriteThrough, setup->TimingOnly, (unsigned long long)getTime(&batch),
+         same ? "same" : "DIFFERENT");
+
+  freeSimulator(&batch);
+  freeSimulator(&access);
+  return same;
+}
+
+int main() {
+
+  uint32_t failed = 0;
+
+  for (uint32_t policy = 0; policy < POLICY_COUNT; policy++) {
+    for (uint32_t ways = 4; ways <= 32; ways *= 8) {
+      for (uint32_t features = 0; features <= 2; features++) {
+        for (uint32_t cores = 1; cores <= 2; cores++) {
+          for (uint32_t timingOnly = 0; timingOnly <= 1; timingOnly++) {
+            Setup setup = {policy, ways, features, cores, features == 1 && cores == 1, timingOnly};
+            failed += !test(&setup);
+          }
+        }
+      }
+    }
+  }
+
+  if (EVENT_TRACE > 0) {
+    remove("BatchTest.batch.evt");
+    remove("BatchTest.access.evt");
+  }
+  printf("%u setups differ\n", failed);
+  return failed != 0;
+}
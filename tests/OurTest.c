@@ -1,56 +1,91 @@
 // Place in same dir as L2_2WCache.h
 #include "L2_2WCache.h"
+#include "Capture.h"
+#include "Events.h"
+
+#include <errno.h>
+
+/*
+With OURTEST_CAPTURE set, the accesses are also captured (see
+Capture.h) into $OURTEST_CAPTURE.0, which TraceReplay replays in the
+time printed last (make capturetest checks it). With OURTEST_EVENTS set,
+a build with EVENT_TRACE records the events (see Events.h) into
+$OURTEST_EVENTS, which make debug turns into debug.out.
+*/
 
 int main() {
 
+  Simulator sim;
+  CaptureStats captured;
   uint32_t value1, value2, value3, value4, clock;
+  const char *capture = getenv("OURTEST_CAPTURE"), *events = getenv("OURTEST_EVENTS");
 
-  resetTime();
-  initL1Cache();
-  initL2Cache();
+  if (capture != NULL && startCapture(capture) < 0) {
+    fprintf(stderr, "Could not start capture %s: %s\n", capture, strerror(errno));
+    return 1;
+  }
+  if (events != NULL && startEvents(events) < 0) {
+    fprintf(stderr, "Could not start events %s: %s\n", events, strerror(errno));
+    return 1;
+  }
+
+  initSimulator(&sim);
+  resetTime(&sim);
+  initL1Cache(&sim);
+  initL2Cache(&sim);
   value1 = 16;
   value2 = 32;
   value3 = 64;
   value4 = 0;
 
-  clock = getTime();
+  clock = getTime(&sim);
   printf("Start Time %d\n", clock);
 
   // Writes to address 0x0000 (tag 0, index 0, offset 0)
-  write(0, (unsigned char *)(&value1));
-  clock = getTime();
+  write(&sim, 0, (unsigned char *)(&value1));
+  clock = getTime(&sim);
   printf("Wrote; Address %d; Value %d; Time %d\n", 0, value1, clock);
 
   // Writes to address 0x4000 to introduce a second line in the L2 set
   // Replaces, naturally, the address 0 in L1 (same index)
-  write(16384, (unsigned char *)(&value2));
-  clock = getTime();
+  write(&sim, 16384, (unsigned char *)(&value2));
+  clock = getTime(&sim);
   printf("Wrote; Address %d; Value %d; Time %d\n", 16384, value2, clock);
 
   // Writes to address 0x8000 to replace one of the lines in the L2 set
-  write(32768, (unsigned char *)(&value3));
-  clock = getTime();
+  write(&sim, 32768, (unsigned char *)(&value3));
+  clock = getTime(&sim);
   printf("Wrote; Address %d; Value %d; Time %d\n", 32768, value3, clock);
 
   // Reads from 0x0000
-  read(0, (unsigned char *)(&value4));
-  clock = getTime();
+  read(&sim, 0, (unsigned char *)(&value4));
+  clock = getTime(&sim);
   printf("Read; Address %d; Value %d; Time %d\n", 0, value4, clock);
 
   // Reads from 0x4000
-  read(16384, (unsigned char *)(&value4));
-  clock = getTime();
+  read(&sim, 16384, (unsigned char *)(&value4));
+  clock = getTime(&sim);
   printf("Read; Address %d; Value %d; Time %d\n", 16384, value4, clock);
 
   // Reads from 0x8000
-  read(32768, (unsigned char *)(&value4));
-  clock = getTime();
+  read(&sim, 32768, (unsigned char *)(&value4));
+  clock = getTime(&sim);
   printf("Read; Address %d; Value %d; Time %d\n", 32768, value4, clock);
 
   // Reads from 0x8000
-  read(32768, (unsigned char *)(&value4));
-  clock = getTime();
+  read(&sim, 32768, (unsigned char *)(&value4));
+  clock = getTime(&sim);
   printf("Read; Address %d; Value %d; Time %d\n", 32768, value4, clock);
 
+  if (capture != NULL && stopCapture(&captured) < 0) {
+    fprintf(stderr, "Could not write capture %s: %s\n", capture, strerror(errno));
+    return 1;
+  }
+  if (events != NULL && stopEvents(NULL) < 0) {
+    fprintf(stderr, "Could not write events %s: %s\n", events, strerror(errno));
+    return 1;
+  }
+
+  freeSimulator(&sim);
   return 0;
 }